@@ -0,0 +1,168 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "CameraModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include <opencv2/imgproc.hpp>
+
+using namespace dragonvision;
+
+bool CameraIntrinsics::IsValidDistortion() const {
+  switch (distortion.size()) {
+    case 0:
+    case 4:
+    case 5:
+    case 8:
+    case 12:
+    case 14:
+      return true;
+    default:
+      return false;
+  }
+}
+
+CameraModel::CameraModel(const CameraIntrinsics& intrinsics, bool angleTable)
+    : m_intrinsics(intrinsics), m_useAngleTable(angleTable) {
+  // All zeros is no distortion; skip undistortPoints' iterations for it
+  for (double k : m_intrinsics.distortion) {
+    if (k != 0.0) {
+      m_distortion = cv::Mat(m_intrinsics.distortion, true).reshape(1, 1);
+      break;
+    }
+  }
+  if (m_intrinsics.IsCalibrated()) SetFrameSize(m_intrinsics.size);
+}
+
+void CameraModel::SetFrameSize(cv::Size size) {
+  if (size == m_size || size.width <= 0 || size.height <= 0) return;
+  m_size = size;
+
+  double fx, fy, cx, cy;
+  if (m_intrinsics.IsCalibrated()) {
+    // Pixel centers, not edges, are at whole coordinates, hence the 0.5s
+    double sx = static_cast<double>(size.width) / m_intrinsics.size.width;
+    double sy = static_cast<double>(size.height) / m_intrinsics.size.height;
+    fx = m_intrinsics.fx * sx;
+    fy = m_intrinsics.fy * sy;
+    cx = (m_intrinsics.cx + 0.5) * sx - 0.5;
+    cy = (m_intrinsics.cy + 0.5) * sy - 0.5;
+  } else {
+    double halfFov = m_intrinsics.horizontalFov * CV_PI / 360.0;
+    fx = fy = size.width / (2.0 * std::tan(halfFov));
+    cx = (size.width - 1) / 2.0;
+    cy = (size.height - 1) / 2.0;
+  }
+  m_matrix = cv::Matx33d(fx, 0.0, cx, 0.0, fy, cy, 0.0, 0.0, 1.0);
+  if (m_useAngleTable) BuildAngleTable();
+}
+
+void CameraModel::BuildAngleTable() {
+  // Enough nodes that the last row and column reach the far edge, and at
+  // least two of each to interpolate between
+  auto nodes = [](int pixels) {
+    return std::max(2, (pixels + kAngleTableStep - 2) / kAngleTableStep + 1);
+  };
+  m_tableCols = nodes(m_size.width);
+  m_tableRows = nodes(m_size.height);
+  std::vector<cv::Point2f> pixels;
+  pixels.reserve(m_tableCols * m_tableRows);
+  for (int row = 0; row < m_tableRows; ++row) {
+    for (int col = 0; col < m_tableCols; ++col) {
+      pixels.emplace_back(static_cast<float>(col * kAngleTableStep),
+                          static_cast<float>(row * kAngleTableStep));
+    }
+  }
+
+  // All nodes in one undistortPoints call
+  std::vector<cv::Point2f> normalized(pixels.size());
+  Normalize(pixels.data(), normalized.data(), static_cast<int>(pixels.size()));
+  m_angles.resize(pixels.size());
+  for (size_t i = 0; i < pixels.size(); ++i) {
+    double horizontal, vertical;
+    Angles(normalized[i], horizontal, vertical);
+    m_angles[i] = cv::Vec2f(static_cast<float>(horizontal),
+                            static_cast<float>(vertical));
+  }
+}
+
+void CameraModel::Normalize(const cv::Point2f* pixels,
+                            cv::Point2f* normalized, int n) const {
+  if (n <= 0) return;
+  if (m_distortion.empty()) {
+    double fx = m_matrix(0, 0), fy = m_matrix(1, 1);
+    double cx = m_matrix(0, 2), cy = m_matrix(1, 2);
+    for (int i = 0; i < n; ++i) {
+      normalized[i] = cv::Point2f(static_cast<float>((pixels[i].x - cx) / fx),
+                                  static_cast<float>((pixels[i].y - cy) / fy));
+    }
+    return;
+  }
+  // Headers over the caller's arrays, so undistortPoints writes in place
+  cv::Mat src(1, n, CV_32FC2, const_cast<cv::Point2f*>(pixels));
+  cv::Mat dst(1, n, CV_32FC2, normalized);
+  cv::undistortPoints(src, dst, m_matrix, m_distortion);
+}
+
+cv::Point2f CameraModel::Normalize(cv::Point2f pixel) const {
+  cv::Point2f normalized;
+  Normalize(&pixel, &normalized, 1);
+  return normalized;
+}
+
+void CameraModel::Angles(cv::Point2f normalized, double& horizontal,
+                         double& vertical) {
+  constexpr double kDegrees = 180.0 / CV_PI;
+  horizontal = std::atan2(-normalized.x, 1.0) * kDegrees;
+  vertical = std::atan2(-normalized.y, std::hypot(normalized.x, 1.0)) *
+             kDegrees;
+}
+
+void CameraModel::PixelAngles(cv::Point2f pixel, double& horizontal,
+                              double& vertical) const {
+  if (m_angles.empty()) {
+    PixelAnglesExact(pixel, horizontal, vertical);
+    return;
+  }
+
+  // Bilinear between the four nodes around the pixel
+  float x = std::clamp(pixel.x, 0.0f, static_cast<float>(m_size.width - 1)) /
+            kAngleTableStep;
+  float y = std::clamp(pixel.y, 0.0f, static_cast<float>(m_size.height - 1)) /
+            kAngleTableStep;
+  int col = std::min(static_cast<int>(x), m_tableCols - 2);
+  int row = std::min(static_cast<int>(y), m_tableRows - 2);
+  float tx = x - col;
+  float ty = y - row;
+  const cv::Vec2f* top = &m_angles[row * m_tableCols + col];
+  const cv::Vec2f* bottom = top + m_tableCols;
+  cv::Vec2f angles = (top[0] * (1 - tx) + top[1] * tx) * (1 - ty) +
+                     (bottom[0] * (1 - tx) + bottom[1] * tx) * ty;
+  horizontal = angles[0];
+  vertical = angles[1];
+}
+
+void CameraModel::PixelAnglesExact(cv::Point2f pixel, double& horizontal,
+                                   double& vertical) const {
+  Angles(Normalize(pixel), horizontal, vertical);
+}
+
+double CameraModel::SphereDistance(cv::Point2f center, double radius,
+                                   double objectRadius) const {
+  if (radius <= 0.0) return std::numeric_limits<double>::infinity();
+
+  // A sphere at distance d fills a cone of half angle asin(r / d); measure
+  // the half angle between the rays through the center and an edge point
+  cv::Point2f pixels[2] = {center,
+                           center + cv::Point2f(static_cast<float>(radius), 0)};
+  cv::Point2f normalized[2];
+  Normalize(pixels, normalized, 2);
+  cv::Vec3d a(normalized[0].x, normalized[0].y, 1.0);
+  cv::Vec3d b(normalized[1].x, normalized[1].y, 1.0);
+  double halfAngle = std::atan2(cv::norm(a.cross(b)), a.dot(b));
+  return objectRadius / std::sin(halfAngle);
+}
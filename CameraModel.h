@@ -0,0 +1,145 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace dragonvision {
+
+/**
+ * A camera's calibration, as read from its "camera model" config: the
+ * pinhole intrinsics and OpenCV distortion coefficients measured at one
+ * resolution (e.g. with cv::calibrateCamera).
+ */
+struct CameraIntrinsics {
+  /** Resolution the calibration was done at; empty if not calibrated. */
+  cv::Size size;
+  double fx = 0.0;
+  double fy = 0.0;
+  double cx = 0.0;
+  double cy = 0.0;
+
+  /**
+   * k1, k2, p1, p2[, k3[, k4, k5, k6[, s1, s2, s3, s4[, tx, ty]]]], as
+   * cv::undistortPoints takes them; empty for none.
+   */
+  std::vector<double> distortion;
+
+  /**
+   * Horizontal field of view in degrees of the ideal pinhole camera, with
+   * square pixels and the principal point in the middle, that stands in
+   * when there is no calibration.
+   */
+  double horizontalFov = 60.0;
+
+  /** True if size, fx and fy describe a calibration. */
+  bool IsCalibrated() const {
+    return size.width > 0 && size.height > 0 && fx > 0.0 && fy > 0.0;
+  }
+
+  /** True if distortion has a length cv::undistortPoints accepts. */
+  bool IsValidDistortion() const;
+};
+
+/**
+ * Maps pixels of the frames a camera delivers to the rays they were seen
+ * along.
+ *
+ * The calibration is scaled to each new frame size, so a camera calibrated
+ * at 640x480 also serves 320x240; a mode with another aspect ratio is
+ * assumed to scale the sensor image, not crop it. Distortion is removed
+ * from the few points asked about, never from whole frames.
+ *
+ * Normalized coordinates are those of the z = 1 plane in front of the
+ * camera: x right, y down.
+ *
+ * With the angle table on, the angles of a grid of pixels every
+ * kAngleTableStep pixels are worked out (undistortion and trig included)
+ * whenever the frame size changes, and PixelAngles() interpolates between
+ * them instead.
+ */
+class CameraModel {
+ public:
+  /** Grid spacing of the angle table, in pixels. */
+  static constexpr int kAngleTableStep = 8;
+
+  explicit CameraModel(const CameraIntrinsics& intrinsics = {},
+                       bool angleTable = true);
+
+  /**
+   * Rescales the model for frames of size, and rebuilds the angle table;
+   * does nothing if that is the size it already has.
+   */
+  void SetFrameSize(cv::Size size);
+
+  cv::Size GetFrameSize() const { return m_size; }
+
+  /** Camera matrix for the current frame size. */
+  const cv::Matx33d& GetCameraMatrix() const { return m_matrix; }
+
+  /** Distortion coefficients as a row of doubles; empty for none. */
+  const cv::Mat& GetDistortion() const { return m_distortion; }
+
+  /**
+   * Undistorts n pixel points of the current frame size into normalized
+   * coordinates. Does not allocate.
+   */
+  void Normalize(const cv::Point2f* pixels, cv::Point2f* normalized,
+                 int n) const;
+
+  cv::Point2f Normalize(cv::Point2f pixel) const;
+
+  /**
+   * Angles of the ray through a normalized point, in degrees: horizontal is
+   * positive to the left of the optical axis (counterclockwise seen from
+   * above) and vertical is the elevation, positive up.
+   */
+  static void Angles(cv::Point2f normalized, double& horizontal,
+                     double& vertical);
+
+  /**
+   * Angles, as Angles() gives them, of the ray through a pixel of the
+   * current frame size: from the angle table if it is on (pixels outside
+   * the frame take the nearest edge's), otherwise by undistorting the pixel.
+   */
+  void PixelAngles(cv::Point2f pixel, double& horizontal,
+                   double& vertical) const;
+
+  /** PixelAngles() without the table. */
+  void PixelAnglesExact(cv::Point2f pixel, double& horizontal,
+                        double& vertical) const;
+
+  /** Bytes the angle table takes; 0 while it is off or not built. */
+  size_t GetAngleTableBytes() const {
+    return m_angles.size() * sizeof(m_angles[0]);
+  }
+
+  /**
+   * Distance along the ray from the camera to the center of a sphere of
+   * objectRadius whose image is a circle of radius pixels centered on
+   * center, in objectRadius' units; infinite for a radius of 0.
+   */
+  double SphereDistance(cv::Point2f center, double radius,
+                        double objectRadius) const;
+
+ private:
+  CameraIntrinsics m_intrinsics;
+  cv::Size m_size;
+  cv::Matx33d m_matrix = cv::Matx33d::eye();
+  cv::Mat m_distortion;
+  bool m_useAngleTable;
+
+  void BuildAngleTable();
+
+  // Horizontal and vertical angle of every kAngleTableStep'th pixel, row by
+  // row; m_tableCols x m_tableRows nodes covering the whole frame
+  std::vector<cv::Vec2f> m_angles;
+  int m_tableCols = 0;
+  int m_tableRows = 0;
+};
+
+}  // namespace dragonvision
@@ -0,0 +1,68 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "CameraTelemetry.h"
+
+#include <algorithm>
+
+using namespace dragonvision;
+
+CameraTelemetry::CameraTelemetry(double period) {
+  cs::SetTelemetryPeriod(period);
+  m_listener = cs::VideoListener([this](const cs::VideoEvent&) { Update(); },
+                                 cs::VideoEvent::kTelemetryUpdated, false);
+}
+
+void CameraTelemetry::AddCamera(cs::VideoSource camera,
+                                std::function<uint64_t()> processed,
+                                std::shared_ptr<nt::NetworkTable> table,
+                                double maxFps) {
+  Camera c;
+  c.camera = camera;
+  c.processed = std::move(processed);
+  c.maxFps = maxFps;
+  c.cameraFps = table->GetEntry("CameraFps");
+  c.cameraMbps = table->GetEntry("CameraMbps");
+  if (c.processed) {
+    c.lastProcessed = c.processed();
+    c.lastUpdate = std::chrono::steady_clock::now();
+    c.processedFps = table->GetEntry("ProcessedFps");
+    c.dropRatio = table->GetEntry("DropRatio");
+    c.fallingBehind = table->GetEntry("FallingBehind");
+  }
+
+  std::scoped_lock lock(m_mutex);
+  m_cameras.emplace_back(std::move(c));
+}
+
+void CameraTelemetry::Update() {
+  std::scoped_lock lock(m_mutex);
+  auto now = std::chrono::steady_clock::now();
+  for (auto& c : m_cameras) {
+    double cameraFps = c.camera.GetActualFPS();
+    c.cameraFps.SetDouble(cameraFps);
+    c.cameraMbps.SetDouble(c.camera.GetActualDataRate() * 8 / 1e6);
+    if (!c.processed) continue;
+
+    // Counted at the pipeline, not at the Processed stream, which only gets
+    // frames while someone watches it
+    uint64_t processed = c.processed();
+    double seconds = std::chrono::duration<double>(now - c.lastUpdate).count();
+    double processedFps =
+        seconds > 0.0 ? (processed - c.lastProcessed) / seconds : 0.0;
+    c.lastProcessed = processed;
+    c.lastUpdate = now;
+    double expectedFps =
+        c.maxFps > 0.0 ? std::min(cameraFps, c.maxFps) : cameraFps;
+    bool behind =
+        expectedFps > 0.0 && processedFps < expectedFps * (1 - kBehindTolerance);
+    c.behindPeriods = behind ? c.behindPeriods + 1 : 0;
+
+    c.processedFps.SetDouble(processedFps);
+    c.dropRatio.SetDouble(
+        cameraFps > 0.0 ? std::clamp(1 - processedFps / cameraFps, 0.0, 1.0)
+                        : 0.0);
+    c.fallingBehind.SetBoolean(c.behindPeriods >= kBehindPeriods);
+  }
+}
@@ -0,0 +1,84 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <networktables/NetworkTable.h>
+#include <networktables/NetworkTableEntry.h>
+
+#include "cscore_oo.h"
+
+namespace dragonvision {
+
+/**
+ * Turns on cscore's source telemetry and publishes, once per telemetry
+ * period, how fast each camera delivers frames next to how fast its pipeline
+ * processes them:
+ *
+ * - CameraFps, CameraMbps: frames and megabits per second from the camera
+ * - ProcessedFps: frames per second the pipeline processed
+ * - DropRatio: share of camera frames that were never processed (0 to 1)
+ * - FallingBehind: true once ProcessedFps has stayed more than
+ *   kBehindTolerance below the rate it should reach (the camera rate, or
+ *   the pipeline's max fps if lower) for kBehindPeriods periods in a row
+ *
+ * Updates run on cscore's notifier thread.
+ */
+class CameraTelemetry {
+ public:
+  static constexpr double kBehindTolerance = 0.1;
+  static constexpr int kBehindPeriods = 2;
+
+  /**
+   * @param period telemetry averaging and publishing period in seconds
+   */
+  explicit CameraTelemetry(double period);
+
+  CameraTelemetry(const CameraTelemetry&) = delete;
+  CameraTelemetry& operator=(const CameraTelemetry&) = delete;
+
+  /**
+   * Publishes telemetry for camera to table.
+   *
+   * @param camera    the camera source
+   * @param processed count of frames the pipeline has processed so far,
+   *                  called from the notifier thread; empty if the camera
+   *                  has no pipeline, in which case only camera values are
+   *                  published
+   * @param table     where to publish
+   * @param maxFps    the pipeline's processing rate cap; 0 for none
+   */
+  void AddCamera(cs::VideoSource camera, std::function<uint64_t()> processed,
+                 std::shared_ptr<nt::NetworkTable> table, double maxFps = 0.0);
+
+ private:
+  struct Camera {
+    cs::VideoSource camera;
+    std::function<uint64_t()> processed;
+    double maxFps;
+    uint64_t lastProcessed = 0;
+    std::chrono::steady_clock::time_point lastUpdate;
+    int behindPeriods = 0;
+    nt::NetworkTableEntry cameraFps;
+    nt::NetworkTableEntry cameraMbps;
+    nt::NetworkTableEntry processedFps;
+    nt::NetworkTableEntry dropRatio;
+    nt::NetworkTableEntry fallingBehind;
+  };
+
+  void Update();
+
+  std::mutex m_mutex;
+  std::vector<Camera> m_cameras;
+  cs::VideoListener m_listener;
+};
+
+}  // namespace dragonvision
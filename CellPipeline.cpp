@@ -0,0 +1,782 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "CellPipeline.h"
+
+#include "CellPipelineTuner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+#include <networktables/NetworkTableInstance.h>
+
+using namespace cv;
+using namespace dragonvision;
+
+// Diameter of a power cell, in the inches distances are published in
+static constexpr double kCellDiameter = 7.0;
+
+// Points view at the top left size of storage, growing storage only when it is too small.
+// The search area changes size from frame to frame, and every new size would otherwise
+// reallocate each scratch image.
+static void FitWindow(Mat& storage, Mat& view, Size size, int type)
+{
+    if (storage.type() != type || storage.cols < size.width || storage.rows < size.height)
+    {
+        storage.create(std::max(storage.rows, size.height), std::max(storage.cols, size.width), type);
+    }
+    view = storage(Rect(Point(), size));
+}
+
+// Time between frames drawn for the "Processed" stream; 0 for every frame.
+static std::chrono::steady_clock::duration OverlayPeriod(const CellPipelineSettings& settings)
+{
+    if (settings.overlayFps <= 0.0)
+    {
+        return std::chrono::steady_clock::duration::zero();
+    }
+    return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / settings.overlayFps));
+}
+
+CellPipeline::CellPipeline(cs::CvSource outputStream,
+                           std::shared_ptr<nt::NetworkTable> table,
+                           const CellPipelineSettings& initialSettings)
+    : outputStream(outputStream), encoder(outputStream), table(std::move(table)),
+      publisher(this->table),
+      settings(std::make_shared<const CellPipelineSettings>(initialSettings)),
+      cameraModel(initialSettings.camera, initialSettings.angleTable),
+      groundPlane(initialSettings.mount, kCellDiameter / 2.0),
+      poseEstimator(PoseEstimator::CellModel(kCellDiameter / 2.0)),
+      bgrLut(initialSettings.lutBits)
+{
+    stages.lut = perf.AddStage("LUT");
+    stages.cvtColor = perf.AddStage("cvtColor");
+    stages.denoise = perf.AddStage("denoise");
+    stages.inRange = perf.AddStage("inRange");
+    stages.threshold = perf.AddStage("threshold");
+    stages.pyramid = perf.AddStage("pyramid");
+    stages.opening = perf.AddStage("morphologyEx");
+    stages.contours = perf.AddStage("findContours");
+    stages.pose = perf.AddStage("pose");
+    stages.udp = perf.AddStage("udp");
+    stages.queue = perf.AddStage("queue");
+    stages.publish = perf.AddStage("publish");
+    stages.flush = perf.AddStage("flush");
+    stages.draw = perf.AddStage("draw");
+    stages.handoff = perf.AddStage("handoff");
+    perf.SetTable(this->table->GetSubTable("perf"), settings->perfRate);
+    if (settings->latency)
+    {
+        perf.SetLatencyTable(this->table->GetSubTable("latency"));
+    }
+    // Writing to NetworkTables allocates, so the timings go out from the publisher's thread too
+    publisher.SetAfterFlush([this] { perf.PublishPending(); });
+
+    // Sinks being enabled, disabled or switched to another source may change who watches
+    streamWatched = this->outputStream.IsEnabled();
+    streamListener = cs::VideoListener(
+        [this](const cs::VideoEvent&) { streamWatched = this->outputStream.IsEnabled(); },
+        cs::VideoEvent::kSinkEnabled | cs::VideoEvent::kSinkDisabled |
+            cs::VideoEvent::kSinkSourceChanged | cs::VideoEvent::kSinkDestroyed,
+        false);
+
+    if (settings->udpPort > 0)
+    {
+        sender = std::make_unique<TargetSender>(settings->udpHost, settings->udpPort);
+    }
+
+    fusedThreshold.SetParams(settings->color);
+    if (settings->threshold == CellPipelineSettings::ThresholdMethod::kLut)
+    {
+        // Start building the table while the camera is still starting up
+        bgrLut.SetParams(settings->color);
+        lutRequestedParams = settings->color;
+        lutRequested = true;
+    }
+    overlayPeriod = OverlayPeriod(*settings);
+
+    if (settings->liveTuning)
+    {
+        tuner = std::make_unique<CellPipelineTuner>(this->table->GetSubTable("tuning"), settings);
+    }
+}
+
+// Here, where CellPipelineTuner is complete
+CellPipeline::~CellPipeline()
+{
+    // Its thread publishes perf, which goes first
+    publisher.Stop();
+}
+
+void CellPipeline::RefreshSettings()
+{
+    // One atomic load per frame while nothing changes
+    if (!tuner || !tuner->Update(settings))
+    {
+        return;
+    }
+    // Only what depends on the settings that changed is rebuilt: the threshold tables and
+    // the opening kernel compare their inputs where they are used
+    overlayPeriod = OverlayPeriod(*settings);
+}
+
+void CellPipeline::Process(Mat& mat, const FrameInfo& frame)
+{
+    // Grab RGB camera feed
+    //Modify Constrast and Brightness to reduce noise
+    // hsvThresholdInput = Mat::zeros( mat.size(), mat.type() );
+    // for( int y = 0; y < mat.rows; y++ ){
+    //   for( int x = 0; x < mat.cols; x++ ){
+    //     for( int c = 0; c < mat.channels(); c++ ){
+    //       hsvThresholdInput.at<Vec3b>(y,x)[c]=
+    //         saturate_cast<uchar>(alpha*mat.at<Vec3b>(y,x)[c] + beta );
+    //     }
+    //   }
+
+    // }
+
+    perf.StartFrame(frame.captureTime, frame.grabTime);
+    Detect(mat, frame);
+
+    // Results first; nothing for the debug stream happens before they are out
+    CellResult result;
+    result.found = largestRadius > 0.0;
+    result.horizontalAngle = horAngle;
+    result.verticalAngle = vertAngle;
+    result.distance = cellDistance;
+    result.x = cellX;
+    result.y = cellY;
+    result.radius = largestRadius;
+    result.center = largestCenter;
+    result.contourID = largestContourID;
+    result.targets = targets;
+    result.poses = settings->pose;
+    // Age of the values above: the robot subtracts the latency (ms) from the time it
+    // receives them to get the time the frame was taken.  The capture timestamp is in the
+    // Pi's wpi::Now() time base (us) and the sequence lets the robot spot stale or skipped
+    // frames.
+    result.sequence = frame.sequence;
+    result.captureTime = frame.captureTime;
+    result.latencyMs = (wpi::Now() - frame.captureTime) / 1000.0;
+    if (sender)
+    {
+        // No update timer in the way; on the wire before NetworkTables is even written
+        sender->Send(result);
+        perf.Mark(stages.udp);
+    }
+    // Handed to the publisher's thread, which writes it and sends it at once instead of at
+    // the next periodic update, so the robot gets the whole frame together and as early as
+    // possible. Its write and flush are charged as they are reported back, a frame or so
+    // later, so the latency table still runs up to NetworkTables.
+    publisher.Publish(result);
+    perf.Mark(stages.queue);
+    ResultPublisher::Timing timing;
+    if (publisher.TakeTiming(timing))
+    {
+        perf.MarkExternal(stages.publish, std::chrono::microseconds(timing.written - timing.writeStart),
+                          timing.captureTime, timing.written);
+        perf.MarkExternal(stages.flush, std::chrono::microseconds(timing.flushed - timing.written),
+                          timing.captureTime, timing.flushed);
+    }
+
+    /**
+    for( size_t i = 0; i < contours.size(); i++ )
+    {
+        if( radius[i] < 40 && radius[i] > 5 && radius[i] > largestRadius)
+        {
+            largestRadius = radius[i];
+            largestContourID = i;
+            table->PutNumber("largestRadius", largestRadius);
+            table->PutNumber("contourID", largestContourID);
+        }
+    }
+    **/
+
+    //double cellDistance = (7.0 * focalLength) / (2.0 * largestRadius);
+
+    // double cellAngle =
+    //table->PutNumber("nearestCellDistance", cellDistance); //distance in inches
+    //table->PutNumber("largestRadius", largestRadius);
+    // Scalar color(0, 0, 255);
+    // drawContours(contourOutput, contours, -1, color, 2, 8);
+    if (OverlayDue())
+    {
+        Draw();
+        perf.Mark(stages.draw);
+        // PutFrame copies the image into cscore and wakes the stream servers,
+        // which compress it; all of that happens on the encoder thread
+        encoder.Put(drawing);
+        perf.Mark(stages.handoff);
+    }
+    perf.EndFrame();
+}
+
+bool CellPipeline::OverlayDue()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now < nextOverlay)
+    {
+        return false;
+    }
+    // Keep to the rate on average, but do not catch up after a pause
+    nextOverlay += overlayPeriod;
+    if (nextOverlay <= now)
+    {
+        nextOverlay = now + overlayPeriod;
+    }
+
+    // MjpegServer clients enable the source without raising a sink event, so
+    // the listener alone would miss them
+    if (now >= nextStreamCheck)
+    {
+        streamWatched = outputStream.IsEnabled();
+        nextStreamCheck = now + std::chrono::seconds(1);
+    }
+    return streamWatched;
+}
+
+void CellPipeline::Detect(Mat& mat, const FrameInfo& frame)
+{
+    RefreshSettings();
+    // Follows video mode changes; nothing to do while the size stays the same
+    cameraModel.SetFrameSize(mat.size());
+    groundPlane.SetCamera(cameraModel);
+    frameSize = mat.size();
+    searchArea = SearchArea(mat, frame);
+    if (!FindCandidates(mat, frame, searchArea) && searchArea.size() != mat.size())
+    {
+        // Lost it inside the window; look at the whole frame before giving up on this one
+        searchArea = Rect(0, 0, mat.cols, mat.rows);
+        FindCandidates(mat, frame, searchArea);
+    }
+    framesSinceFullSearch = searchArea.size() == mat.size() ? 0 : framesSinceFullSearch + 1;
+
+    largestContourID = 0;
+    largestRadius = 0.0;
+    largestCenter = cv::Point2f(0.0, 0.0);
+
+    for( int i = 0; i < contours_poly.Size(); i++ )
+    {
+        if( radius[i] < settings->maxCellRadius && radius[i] > largestRadius)
+        {
+            largestRadius = radius[i];
+            largestContourID = i;
+            largestCenter = centers[i];
+        }
+    }
+
+    // Remember where the cell was so the next frame only has to search around it
+    trackedCenter = largestCenter;
+    trackedRadius = largestRadius;
+    trackedSequence = frame.sequence;
+
+    CellAngles(largestCenter, horAngle, vertAngle);
+    LocateCell(largestCenter, largestRadius, cellDistance, cellX, cellY);
+
+    RankTargets();
+    if (settings->pose)
+    {
+        EstimatePoses();
+    }
+    else
+    {
+        previousTargets.clear();
+    }
+}
+
+void CellPipeline::RankTargets()
+{
+    // Every candidate the loop in Detect() would take if it were the only one, except those
+    // centered inside a larger one: the hole of a ring, or a cell split in two by a seam
+    targets.clear();
+    for( int i = 0; i < contours_poly.Size(); i++ )
+    {
+        if( radius[i] >= settings->maxCellRadius || radius[i] <= 0.0f )
+        {
+            continue;
+        }
+        bool nested = false;
+        for( int j = 0; j < contours_poly.Size() && !nested; j++ )
+        {
+            bool larger = radius[j] > radius[i] || (radius[j] == radius[i] && j < i);
+            nested = j != i && larger && radius[j] < settings->maxCellRadius &&
+                     norm(centers[i] - centers[j]) < radius[j];
+        }
+        if (nested)
+        {
+            continue;
+        }
+
+        CellTarget target;
+        target.contourID = i;
+        target.center = centers[i];
+        target.radius = radius[i];
+        CellAngles(centers[i], target.horizontalAngle, target.verticalAngle);
+        target.onGround = LocateCell(centers[i], radius[i], target.distance, target.x, target.y);
+        // How much of its enclosing circle the outline fills; 1 for a perfect disc
+        double circleArea = CV_PI * radius[i] * radius[i];
+        target.confidence = std::min(1.0, contourArea(contours_poly.Polygon(i)) / circleArea);
+        targets.push_back(target);
+    }
+
+    // Highest score first; ties go to the earlier contour
+    Point2f frameCenter(frameSize.width / 2.0f, frameSize.height / 2.0f);
+    auto score = [&](const CellTarget& target) {
+        switch (settings->rankBy)
+        {
+            case CellPipelineSettings::RankBy::kDistance:
+                return -target.distance;
+            case CellPipelineSettings::RankBy::kCenterOffset:
+                return -norm(target.center - frameCenter);
+            default:
+                return target.radius;
+        }
+    };
+    std::sort(targets.begin(), targets.end(), [&](const CellTarget& a, const CellTarget& b) {
+        double scoreA = score(a);
+        double scoreB = score(b);
+        return scoreA != scoreB ? scoreA > scoreB : a.contourID < b.contourID;
+    });
+    if (targets.size() > static_cast<size_t>(std::max(0, settings->maxTargets)))
+    {
+        targets.resize(std::max(0, settings->maxTargets));
+    }
+}
+
+void CellPipeline::EstimatePoses()
+{
+    const PolygonPool& contours = contourFinder.Contours();
+    for (CellTarget& target : targets)
+    {
+        // Left, right, top and bottom of the outline, as CellModel() has them.  The contour runs
+        // through the edge pixels' centers; the ball's edge is half a pixel further out
+        const Point* points = contours.Points(target.contourID);
+        int count = contours.Count(target.contourID);
+        Point left = points[0], right = points[0], top = points[0], bottom = points[0];
+        for (int j = 1; j < count; j++)
+        {
+            left = points[j].x < left.x ? points[j] : left;
+            right = points[j].x > right.x ? points[j] : right;
+            top = points[j].y < top.y ? points[j] : top;
+            bottom = points[j].y > bottom.y ? points[j] : bottom;
+        }
+        Point2f limbs[4] = {Point2f(left) - Point2f(0.5f, 0.0f), Point2f(right) + Point2f(0.5f, 0.0f),
+                            Point2f(top) - Point2f(0.0f, 0.5f), Point2f(bottom) + Point2f(0.0f, 0.5f)};
+
+        // What the ground plane or the radius gives: the center's ray, as far out as the distance
+        Point2f ray = cameraModel.Normalize(target.center);
+        Vec3d radiusTranslation = normalize(Vec3d(ray.x, ray.y, 1.0)) * target.distance;
+
+        // Warm start from the same cell last frame, if it was fitted and has not moved further
+        // than its radius; otherwise start from the radius estimate
+        TargetPose pose{Vec3d(), radiusTranslation};
+        for (const CellTarget& previous : previousTargets)
+        {
+            if (previous.poseValid && norm(previous.center - target.center) < target.radius)
+            {
+                pose = TargetPose{previous.rotation, previous.translation};
+                break;
+            }
+        }
+
+        target.poseValid = poseEstimator.Solve(cameraModel, limbs, pose, settings->poseBudgetUs,
+                                               settings->poseMaxError);
+        if (target.poseValid)
+        {
+            target.translation = pose.translation;
+            target.rotation = pose.rotation;
+            // The ground plane, where it applies, is steadier than a fit to the outline
+            if (!target.onGround)
+            {
+                target.distance = norm(pose.translation);
+                groundPlane.Position(pose.translation, target.x, target.y);
+                if (target.contourID == largestContourID)
+                {
+                    cellDistance = target.distance;
+                    cellX = target.x;
+                    cellY = target.y;
+                }
+            }
+        }
+        else
+        {
+            target.translation = radiusTranslation;
+            target.rotation = Vec3d();
+        }
+    }
+    // Assignment keeps previousTargets' capacity
+    previousTargets = targets;
+    perf.Mark(stages.pose);
+}
+
+void CellPipeline::CellAngles(Point2f center, double& horAngle, double& vertAngle) const
+{
+    // Measured from the optical axis, through the lens model: counterclockwise (left) and up
+    // are positive.  Interpolated from the angle table unless it is off
+    cameraModel.PixelAngles(center, horAngle, vertAngle);
+}
+
+double CellPipeline::CellDistance(Point2f center, double radius) const
+{
+    // A cell is a 7 inch ball; its apparent size gives the distance to its center
+    return cameraModel.SphereDistance(center, radius, kCellDiameter / 2.0);
+}
+
+bool CellPipeline::LocateCell(Point2f center, double radius, double& distance, double& x, double& y) const
+{
+    // Where the ray through the center meets the plane of cell centers, 3.5 inches up; no
+    // radius is no cell
+    Point2f ray = cameraModel.Normalize(center);
+    if (radius > 0.0 && groundPlane.Locate(ray, distance, x, y))
+    {
+        return true;
+    }
+    distance = CellDistance(center, radius);
+    if (!std::isfinite(distance))
+    {
+        x = y = 0.0;
+        return false;
+    }
+    groundPlane.Position(normalize(Vec3d(ray.x, ray.y, 1.0)) * distance, x, y);
+    return false;
+}
+
+const Mat& CellPipeline::Draw()
+{
+    // Clear last frame's canvas rather than allocating a new one
+    drawing.create(frameSize, CV_8UC3);
+    drawing = Scalar::all(0);
+
+    Scalar color {0., 255., 0.};
+    for (const CellTarget& target : targets)
+    {
+        int i = target.contourID;
+        // line() by line() and two one pixel circles: polylines(), drawContours() and thick
+        // circles all build their vertices in a std::vector first
+        const Point* points = contours_poly.Points(i);
+        int count = contours_poly.Count(i);
+        for (int j = 0; j < count; j++)
+        {
+            line( drawing, points[j], points[(j + 1) % count], color);
+        }
+        circle( drawing, centers[i], (int)radius[i], color);
+        circle( drawing, centers[i], (int)radius[i] + 1, color);
+
+        // String radiusText = std::to_string(radius[i]);
+        // putText(drawing, radiusText, centers[i], CV_FONT_HERSHEY_DUPLEX, 1.5, color, 2, LINE_4, false);
+    }
+
+    if (settings->roiTracking && searchArea.size() != frameSize)
+    {
+        rectangle( drawing, searchArea, Scalar {255., 0., 0.});
+    }
+    return drawing;
+}
+
+Rect CellPipeline::SearchArea(const Mat& mat, const FrameInfo& frame)
+{
+    Rect fullFrame(0, 0, mat.cols, mat.rows);
+    if (!settings->roiTracking || trackedRadius <= 0.0f ||
+        framesSinceFullSearch >= settings->roiFullFrameInterval)
+    {
+        return fullFrame;
+    }
+
+    // The more camera frames since the last detection, the further it may have moved
+    uint64_t framesElapsed = std::max<uint64_t>(1, frame.sequence - trackedSequence);
+    double halfSize = trackedRadius * settings->roiRadiusScale + settings->roiMotion * framesElapsed;
+
+    Rect window(cvFloor(trackedCenter.x - halfSize), cvFloor(trackedCenter.y - halfSize),
+                cvCeil(2 * halfSize), cvCeil(2 * halfSize));
+    if (frame.pixelFormat == cs::VideoMode::kYUYV)
+    {
+        // keep whole YUYV pixel pairs
+        window.x &= ~1;
+        window.width = (window.width + 1) & ~1;
+    }
+    window &= fullFrame;
+
+    // A sliver at the edge of the image is not worth the medianBlur/morphology border effects
+    if (window.width < 16 || window.height < 16)
+    {
+        return fullFrame;
+    }
+    return window;
+}
+
+bool CellPipeline::FindCandidates(Mat& mat, const FrameInfo& frame, const Rect& searchArea)
+{
+    contourFinder.Clear();
+    if (settings->pyramidLevels > 0)
+    {
+        for (const Rect& window : CoarseWindows(mat, frame, searchArea))
+        {
+            FindContoursIn(mat, frame, window);
+        }
+    }
+    else
+    {
+        FindContoursIn(mat, frame, searchArea);
+    }
+
+    const PolygonPool& contours = contourFinder.Contours();
+    contours_poly.Clear();
+    centers.resize( contours.Size() );
+    radius.resize( contours.Size() );
+
+    bool anyCandidate = false;
+    for( int i = 0; i < contours.Size(); i++ )
+    {
+      approximator.Approximate( contours.Points(i), contours.Count(i), 3, contours_poly);
+      minEnclosingCircle( contours_poly.Polygon(i), centers[i], radius[i]);
+      anyCandidate = anyCandidate || (radius[i] < settings->maxCellRadius && radius[i] > 0.0f);
+    }
+    perf.Mark(stages.contours);
+    return anyCandidate;
+}
+
+void CellPipeline::FindContoursIn(Mat& mat, const FrameInfo& frame, const Rect& area)
+{
+    Mat areaImage = mat(area);
+    Threshold(areaImage, frame, settings->blurSize);
+    FitWindow(openingStorage, openingOutput, area.size(), CV_8U);
+
+    //Use "Opening" operation to clean up binary img.  The kernel only changes with its size;
+    //a 1x1 one copies the mask, which is what passing 5 as the kernel always did
+    if (openingKernelSize != settings->openingSize)
+    {
+        openingKernel = getStructuringElement(MORPH_ELLIPSE, Size(settings->openingSize, settings->openingSize));
+        openingKernelSize = settings->openingSize;
+    }
+    morphologyEx(hsvThresholdOutput, openingOutput, MORPH_OPEN, openingKernel);
+    perf.Mark(stages.opening);
+
+    //Find the contours, and draw them on video feed, to be sent to Driver Station
+    //The offset puts the points back into full frame coordinates.  Same contours as
+    //findContours(RETR_TREE, CHAIN_APPROX_SIMPLE), without its per call allocations
+    contourFinder.Find(openingOutput, ContourFinder::Mode::kTree, area.tl());
+    perf.Mark(stages.contours);
+}
+
+const std::vector<Rect>& CellPipeline::CoarseWindows(Mat& mat, const FrameInfo& frame, const Rect& searchArea)
+{
+    int levels = std::min(settings->pyramidLevels, CellPipelineSettings::kMaxPyramidLevels);
+    int scale = 1 << levels;
+    Mat searchImage = mat(searchArea);
+
+    if (frame.pixelFormat == cs::VideoMode::kYUYV)
+    {
+        // Decimate whole Y0 U Y1 V pixel pairs (as 4 channel pixels) so the chroma stays with its pair
+        Mat pairs(searchImage.rows, searchImage.cols / 2, CV_8UC4, searchImage.data, searchImage.step);
+        Size coarseSize(std::max(1, pairs.cols / scale), std::max(1, pairs.rows / scale));
+        FitWindow(coarsePairsStorage, coarsePairs, coarseSize, CV_8UC4);
+        resize(pairs, coarsePairs, coarseSize, 0, 0, INTER_NEAREST);
+        coarseImage = Mat(coarsePairs.rows, coarsePairs.cols * 2, CV_8UC2, coarsePairs.data, coarsePairs.step);
+    }
+    else
+    {
+        pyrDown(searchImage, coarseImage);
+        for (int level = 1; level < levels; ++level)
+        {
+            pyrDown(coarseImage, coarseImage);
+        }
+    }
+    perf.Mark(stages.pyramid);
+
+    // Scale the median down with the image so small cells survive it
+    Threshold(coarseImage, frame, std::max(1, (settings->blurSize / scale) | 1));
+    coarseFinder.Clear();
+    coarseFinder.Find(hsvThresholdOutput, ContourFinder::Mode::kExternal);
+    perf.Mark(stages.contours);
+
+    // Pad each blob enough to cover pyramid rounding and the denoise and opening windows at
+    // full resolution
+    int pad = 2 * scale + settings->blurSize / 2 + settings->openingSize / 2 + 1;
+    coarseWindows.clear();
+    const PolygonPool& blobs = coarseFinder.Contours();
+    for (int i = 0; i < blobs.Size(); i++)
+    {
+        Rect blob = boundingRect(blobs.Polygon(i));
+        if (std::max(blob.width, blob.height) * scale > 4 * settings->maxCellRadius)
+        {
+            continue;  // far too big to be a cell at full resolution
+        }
+        Rect window(searchArea.x + blob.x * scale - pad, searchArea.y + blob.y * scale - pad,
+                    blob.width * scale + 2 * pad, blob.height * scale + 2 * pad);
+        if (frame.pixelFormat == cs::VideoMode::kYUYV)
+        {
+            window.x &= ~1;
+            window.width = (window.width + 1) & ~1;
+        }
+        window &= searchArea;
+
+        // Overlapping windows would report the same cell twice, so merge them; a merged
+        // window can reach ones already passed over, hence the restart
+        for (auto it = coarseWindows.begin(); it != coarseWindows.end();)
+        {
+            if ((*it & window).area() > 0)
+            {
+                window |= *it;
+                coarseWindows.erase(it);
+                it = coarseWindows.begin();
+            }
+            else
+            {
+                ++it;
+            }
+        }
+        coarseWindows.push_back(window);
+    }
+    return coarseWindows;
+}
+
+void CellPipeline::Threshold(Mat& mat, const FrameInfo& frame, int blurSize)
+{
+    FitWindow(rawMaskStorage, rawMask, mat.size(), CV_8U);
+    FitWindow(maskStorage, hsvThresholdOutput, mat.size(), CV_8U);
+
+    if (frame.pixelFormat == cs::VideoMode::kYUYV &&
+        (settings->denoise == CellPipelineSettings::DenoiseMethod::kHsvMedian ||
+         settings->denoise == CellPipelineSettings::DenoiseMethod::kHsvBox))
+    {
+        // The HSV denoise modes need the HSV image, which the table never builds; filtering
+        // the mask instead would find a different one, so take the BGR route
+        FitWindow(yuyvBgrStorage, yuyvBgr, mat.size(), CV_8UC3);
+        cvtColor(mat, yuyvBgr, cv::COLOR_YUV2BGR_YUYV);
+        perf.Mark(stages.cvtColor);
+        FrameInfo bgrFrame = frame;
+        bgrFrame.pixelFormat = cs::VideoMode::kBGR;
+        Threshold(yuyvBgr, bgrFrame, blurSize);
+        return;
+    }
+
+    if (frame.pixelFormat == cs::VideoMode::kYUYV)
+    {
+        // Raw YUYV straight from the camera: one table lookup per pixel, no BGR or HSV image.
+        // The table takes about a second to build, so it is rebuilt in the background when
+        // the parameters change and the previous one is used until then
+        if (!yuyvRequested || yuyvRequestedParams != settings->color)
+        {
+            yuyvThreshold.SetParams(settings->color);
+            yuyvRequestedParams = settings->color;
+            yuyvRequested = true;
+        }
+        if (!yuyvThreshold.Apply(mat, rawMask))
+        {
+            // No table yet: convert the frames before the first one and use the fused
+            // kernel, which keeps the same pixels as the table built from that conversion
+            FitWindow(yuyvBgrStorage, yuyvBgr, mat.size(), CV_8UC3);
+            cvtColor(mat, yuyvBgr, cv::COLOR_YUV2BGR_YUYV);
+            if (fusedThreshold.GetParams() != settings->color)
+            {
+                fusedThreshold.SetParams(settings->color);
+            }
+            fusedThreshold.Apply(yuyvBgr, rawMask);
+        }
+        perf.Mark(stages.threshold);
+
+        // There is no HSV image to blur on this path, so filter the mask instead
+        DenoiseMask(blurSize);
+        return;
+    }
+
+    if (settings->threshold == CellPipelineSettings::ThresholdMethod::kLut)
+    {
+        // One bit table lookup per pixel; the table is rebuilt in the
+        // background when the parameters change, and the fused kernel
+        // covers the frames before the first one is ready. SetParams() takes
+        // a lock, so only call it when the parameters change
+        if (!lutRequested || lutRequestedParams != settings->color)
+        {
+            bgrLut.SetParams(settings->color);
+            lutRequestedParams = settings->color;
+            lutRequested = true;
+        }
+        if (!bgrLut.Apply(mat, rawMask))
+        {
+            if (fusedThreshold.GetParams() != settings->color)
+            {
+                fusedThreshold.SetParams(settings->color);
+            }
+            fusedThreshold.Apply(mat, rawMask);
+        }
+        perf.Mark(stages.threshold);
+        DenoiseMask(blurSize);
+        return;
+    }
+
+    if (settings->threshold == CellPipelineSettings::ThresholdMethod::kFused)
+    {
+        // Gamma, HSV and inRange in one pass over the BGR image
+        if (fusedThreshold.GetParams() != settings->color)
+        {
+            fusedThreshold.SetParams(settings->color);
+        }
+        fusedThreshold.Apply(mat, rawMask);
+        perf.Mark(stages.threshold);
+        DenoiseMask(blurSize);
+        return;
+    }
+
+    //Gamma Correction of raw image feed; the table only changes with the gamma
+    if (gammaTable.empty() || gammaTableGamma != settings->color.gamma)
+    {
+        gammaTable = MakeGammaTable(settings->color.gamma);
+        gammaTableGamma = settings->color.gamma;
+    }
+    FitWindow(gammaStorage, hsvThresholdInput, mat.size(), mat.type());
+    FitWindow(hsvStorage, hsv_image, mat.size(), mat.type());
+    FitWindow(blurStorage, blurOutput, mat.size(), mat.type());
+    LUT(mat, gammaTable, hsvThresholdInput);
+    perf.Mark(stages.lut);
+
+    contourOutput = hsvThresholdInput;
+    //Convert RGB image into HSV image
+    cvtColor(hsvThresholdInput, hsv_image, cv::COLOR_BGR2HSV);
+    perf.Mark(stages.cvtColor);
+
+    switch (settings->denoise)
+    {
+        case CellPipelineSettings::DenoiseMethod::kHsvMedian:
+            //Blur HSV Image using median blur
+            medianBlur( hsv_image, blurOutput, blurSize);
+            break;
+        case CellPipelineSettings::DenoiseMethod::kHsvBox:
+            // Box mean is separable, so it costs the same for any blurSize
+            blur( hsv_image, blurOutput, Size(blurSize, blurSize));
+            break;
+        default:
+            // Denoise the single channel mask instead of all three HSV channels
+            inRange(hsv_image, settings->color.hsvLow, settings->color.hsvHigh, rawMask);
+            perf.Mark(stages.inRange);
+            DenoiseMask(blurSize);
+            return;
+    }
+    perf.Mark(stages.denoise);
+
+    //Threshold HSV image into binary image; the bounds can be tuned live (CellPipelineTuner)
+    inRange(blurOutput, settings->color.hsvLow, settings->color.hsvHigh, hsvThresholdOutput);
+    perf.Mark(stages.inRange);
+}
+
+void CellPipeline::DenoiseMask(int blurSize)
+{
+    switch (settings->denoise)
+    {
+        case CellPipelineSettings::DenoiseMethod::kMaskMajority:
+            MajorityFilter(rawMask, blurSize, maskSum, hsvThresholdOutput);
+            break;
+        case CellPipelineSettings::DenoiseMethod::kNone:
+            rawMask.copyTo(hsvThresholdOutput);
+            break;
+        default:
+            medianBlur( rawMask, hsvThresholdOutput, blurSize);
+            break;
+    }
+    perf.Mark(stages.denoise);
+}
@@ -0,0 +1,444 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include <networktables/NetworkTable.h>
+
+#include "cscore_cv.h"
+#include "CameraModel.h"
+#include "ColorThreshold.h"
+#include "ContourFinder.h"
+#include "GroundPlane.h"
+#include "PoseEstimator.h"
+#include "ResultPublisher.h"
+#include "StageTimer.h"
+#include "StreamEncoder.h"
+#include "TargetSender.h"
+#include "TimedVisionPipeline.h"
+
+namespace dragonvision {
+
+class CellPipelineTuner;
+
+/**
+ * Tuning knobs for CellPipeline that come from the camera's "vision" config.
+ * Unless liveTuning is off, most of them can also be changed while running
+ * through the "tuning" subtable; see CellPipelineTuner.
+ */
+struct CellPipelineSettings {
+  /** Gamma and HSV bounds of the color threshold. */
+  ColorThresholdParams color;
+
+  static constexpr int kMaxKernelSize = 31;
+
+  /** True for an odd kernel size from 1 to kMaxKernelSize. */
+  static constexpr bool IsValidKernelSize(int size) {
+    return size >= 1 && size <= kMaxKernelSize && size % 2 == 1;
+  }
+
+  /** Size of the denoise filter window (see DenoiseMethod); odd. */
+  int blurSize = 7;
+
+  /**
+   * Size of the elliptical opening applied to the mask; odd, and 1 leaves
+   * the mask alone (as the pipeline always has).
+   */
+  int openingSize = 1;
+
+  /** Candidates with a radius of this many pixels or more are not cells. */
+  double maxCellRadius = 30.0;
+
+  /**
+   * Calibration of the camera the angles and distances are computed with;
+   * not live tunable.
+   */
+  CameraIntrinsics camera;
+
+  /**
+   * Look the cells' angles up in a table built for each video mode instead
+   * of undistorting and doing the trig per cell; see CameraModel.
+   */
+  bool angleTable = true;
+
+  /**
+   * How the camera is mounted; not live tunable. With a height, cells are
+   * taken to rest on the carpet and located by where their center is seen
+   * (see GroundPlane) rather than by their radius, as long as they are
+   * seen below the horizon. The pitch and yaw also turn every position
+   * into the robot's frame.
+   */
+  CameraMount mount;
+
+  /**
+   * Also fit each ranked cell's pose with PoseEstimator, starting from the
+   * same cell's pose in the previous frame, and publish them as "CellPoses".
+   * A fit that takes longer than poseBudgetUs microseconds or misses the
+   * outline by more than poseMaxError pixels (RMS) is dropped for the
+   * radius estimate.
+   */
+  bool pose = false;
+  double poseBudgetUs = 500.0;
+  double poseMaxError = 2.0;
+
+  enum class ThresholdMethod {
+    /** Gamma LUT, BGR2HSV, median blur on HSV, inRange (the original chain). */
+    kChain,
+    /** FusedColorThreshold, then median blur on the mask. */
+    kFused,
+    /**
+     * BgrThresholdLut, then median blur on the mask. Frames are thresholded
+     * with kFused until the first table is built.
+     */
+    kLut
+  };
+
+  /**
+   * How BGR frames are turned into a mask. YUYV frames use
+   * YuyvThresholdTable, and are converted to BGR for kFused until its first
+   * table is built. With an HSV denoise method they are converted to BGR
+   * and take this method instead, so the mask is the same as a BGR camera's.
+   */
+  ThresholdMethod threshold = ThresholdMethod::kChain;
+
+  enum class DenoiseMethod {
+    /** Median on the HSV image before inRange (the original). */
+    kHsvMedian,
+    /** Separable box mean on the HSV image before inRange. */
+    kHsvBox,
+    /** Median on the mask after inRange. */
+    kMaskMedian,
+    /** Majority vote on the mask; same result as kMaskMedian, faster. */
+    kMaskMajority,
+    /** No denoising; only the opening after thresholding. */
+    kNone
+  };
+
+  /**
+   * How the thresholded image is cleaned up. Threshold methods that never
+   * build an HSV image (kFused, kLut) use kMaskMedian in place of the HSV
+   * options; YUYV frames are converted to BGR for them (see threshold).
+   * kFused or kLut with kMaskMajority never allocate per frame; the default,
+   * the original chain, does inside medianBlur.
+   */
+  DenoiseMethod denoise = DenoiseMethod::kHsvMedian;
+
+  /**
+   * Bits per BGR channel of the kLut table; 8 is exact, fewer trade accuracy
+   * near the HSV bounds for a smaller table.
+   */
+  int lutBits = BgrThresholdLut::kDefaultBitsPerChannel;
+
+  /**
+   * Once a cell is found, only search a window around it in the next frame.
+   */
+  bool roiTracking = false;
+
+  /**
+   * Half-size of the search window, in multiples of the last cell radius.
+   */
+  double roiRadiusScale = 2.0;
+
+  /**
+   * Pixels the cell may move between consecutive camera frames; added to the
+   * half-size once per frame since the last detection.
+   */
+  double roiMotion = 20.0;
+
+  /**
+   * Search the whole frame at least this often even while tracking.
+   */
+  int roiFullFrameInterval = 15;
+
+  /**
+   * Number of pyrDown levels to find candidates on before refining them at
+   * full resolution; 0 searches at full resolution only. Cells whose radius
+   * is at least 4 << pyramidLevels pixels are found with the same center and
+   * radius as a full-resolution search, within kPyramidTolerance pixels.
+   */
+  int pyramidLevels = 0;
+
+  static constexpr int kMaxPyramidLevels = 3;
+  static constexpr double kPyramidTolerance = 1.0;
+
+  /**
+   * Times per second the stage timings are published to the "perf"
+   * subtable; 0 turns publishing off. See StageTimer.
+   */
+  double perfRate = 2.0;
+
+  enum class RankBy {
+    /** Largest radius first. */
+    kSize,
+    /** Nearest first. */
+    kDistance,
+    /** Closest to the middle of the image first. */
+    kCenterOffset
+  };
+
+  /** Order of the cells in the "Cells" array. */
+  RankBy rankBy = RankBy::kSize;
+
+  /** Most cells published in the "Cells" array per frame. */
+  int maxTargets = 5;
+
+  /**
+   * Also send every frame's targets as a TargetDatagram to this IP address
+   * and port, straight from the vision thread; port 0 turns it off.
+   */
+  std::string udpHost;
+  int udpPort = 0;
+
+  /**
+   * Most frames per second drawn and sent to the "Processed" stream while
+   * someone is watching it; 0 sends every processed frame. Nothing is drawn
+   * or encoded while no one is.
+   */
+  double overlayFps = 15.0;
+
+  /**
+   * Also track how old each stage's output is relative to the frame's
+   * capture, and publish the statistics to the "latency" subtable.
+   */
+  bool latency = false;
+
+  /**
+   * Publish the tunable settings to the "tuning" subtable and apply changes
+   * made there from the next frame on.
+   */
+  bool liveTuning = true;
+};
+
+/**
+ * Finds power cells by color and publishes the angle and distance to the
+ * nearest one in a NetworkTables table, one flushed record per frame (see
+ * ResultPublisher). Every cell found goes out as well, ranked by
+ * CellPipelineSettings::rankBy.
+ *
+ * Accepts BGR frames, or packed YUYV frames (CV_8UC2) when the frame's
+ * pixel format says so; see PipelineRunnerBase::FrameFormat.
+ *
+ * Settings are read from an immutable snapshot that CellPipelineTuner
+ * replaces when a tuning entry changes; a frame uses one snapshot from
+ * start to end.
+ *
+ * The annotated image is only drawn and put to the output stream while a
+ * client is connected to it, at most CellPipelineSettings::overlayFps
+ * times per second, after the results are published. A StreamEncoder
+ * thread puts it to the stream.
+ */
+class CellPipeline : public TimedVisionPipeline {
+ public:
+  /**
+   * @param outputStream where the annotated debug image is sent
+   * @param table        where results are published
+   * @param settings     tuning from the camera config
+   */
+  CellPipeline(cs::CvSource outputStream,
+               std::shared_ptr<nt::NetworkTable> table,
+               const CellPipelineSettings& settings = {});
+  ~CellPipeline() override;
+
+  using TimedVisionPipeline::Process;
+  void Process(cv::Mat& mat, const FrameInfo& frame) override;
+
+  /**
+   * The vision half of Process(): finds the cells in mat and picks the
+   * nearest one, without drawing or publishing anything. Every buffer it
+   * uses is kept between frames, so once they have grown to fit the busiest
+   * frame it does not allocate, provided the threshold and denoise settings
+   * stay clear of the OpenCV filters that allocate scratch on every call
+   * (medianBlur, blur and pyrDown) and poses are off (solvePnP allocates).
+   * Neither does the rest of Process(): NetworkTables is written from
+   * ResultPublisher's thread. VisionBench alloc checks this.
+   */
+  void Detect(cv::Mat& mat, const FrameInfo& frame);
+
+  /**
+   * Draws the ranked cells and search window of the last Detect() into the
+   * debug image. The buffers are reused from frame to frame.
+   */
+  const cv::Mat& Draw();
+
+  /**
+   * Center of the largest cell in the last frame, in full-frame pixels.
+   */
+  cv::Point2f GetNearestCellCenter() const { return trackedCenter; }
+
+  /**
+   * Radius of the largest cell in the last frame; 0 if none was found.
+   */
+  float GetNearestCellRadius() const { return trackedRadius; }
+
+  /**
+   * The settings the last frame was processed with.
+   */
+  const CellPipelineSettings& GetSettings() const { return *settings; }
+
+  /**
+   * Results the publisher's thread had no time to write before the next
+   * frame's replaced them; also published as "ResultsSkipped".
+   */
+  uint64_t GetResultsSkipped() const { return publisher.GetSkipped(); }
+
+  std::vector<StageSummary> GetStageSummary() const override {
+    return perf.GetSummary();
+  }
+
+ private:
+    // Switches to the tuner's latest snapshot if there is a newer one.
+    void RefreshSettings();
+
+    // True if this frame should be drawn and put to the output stream.
+    bool OverlayDue();
+
+    // Fills targets from the candidates, best first by settings.rankBy.
+    void RankTargets();
+
+    // Fits the ranked cells' poses, seeded from last frame's, and takes the fitted distance
+    // for those not located on the ground plane, the nearest cell's included.
+    void EstimatePoses();
+
+    // Angles of a cell centered at center, and distance to one of radius,
+    // both in the units published to the table (degrees, inches).
+    void CellAngles(cv::Point2f center, double& horAngle, double& vertAngle) const;
+    double CellDistance(cv::Point2f center, double radius) const;
+
+    // Distance to a cell centered at center and where it is on the carpet (inches): from the
+    // ground plane if the camera's mount is set and the cell is below the horizon, which
+    // returns true, otherwise from its radius.
+    bool LocateCell(cv::Point2f center, double radius, double& distance, double& x, double& y) const;
+
+    // Fills hsvThresholdOutput with the denoised color mask of mat.
+    void Threshold(cv::Mat& mat, const FrameInfo& frame, int blurSize);
+
+    // Fills hsvThresholdOutput from rawMask according to settings.denoise.
+    void DenoiseMask(int blurSize);
+
+    // Where to look in this frame: a window around the tracked cell, or the
+    // whole frame.
+    cv::Rect SearchArea(const cv::Mat& mat, const FrameInfo& frame);
+
+    // Thresholds searchArea of mat and fills contourFinder, contours_poly,
+    // centers and radius in full-frame coordinates. Returns true if any contour is a
+    // cell candidate.
+    bool FindCandidates(cv::Mat& mat, const FrameInfo& frame, const cv::Rect& searchArea);
+
+    // Thresholds area of mat at full resolution and appends its contours.
+    void FindContoursIn(cv::Mat& mat, const FrameInfo& frame, const cv::Rect& area);
+
+    // Finds blobs in a downscaled copy of searchArea and returns padded
+    // full-resolution windows around them.
+    const std::vector<cv::Rect>& CoarseWindows(cv::Mat& mat, const FrameInfo& frame, const cv::Rect& searchArea);
+
+    cs::CvSource outputStream;
+    StreamEncoder encoder;
+    std::shared_ptr<nt::NetworkTable> table;
+    ResultPublisher publisher;
+    std::unique_ptr<TargetSender> sender;
+
+    // Read only by the vision thread; replaced by RefreshSettings()
+    std::shared_ptr<const CellPipelineSettings> settings;
+    std::unique_ptr<CellPipelineTuner> tuner;
+
+    // Scaled to each new frame size in Detect()
+    CameraModel cameraModel;
+    GroundPlane groundPlane;
+    PoseEstimator poseEstimator;
+    YuyvThresholdTable yuyvThreshold;
+    FusedColorThreshold fusedThreshold;
+    BgrThresholdLut bgrLut;
+
+    // Parameters last handed to yuyvThreshold and bgrLut, so an unchanged
+    // frame skips their locks
+    ColorThresholdParams yuyvRequestedParams, lutRequestedParams;
+    bool yuyvRequested = false, lutRequested = false;
+
+    // Per-stage timing, published under table/perf
+    StageTimer perf;
+    struct Stages
+    {
+        StageTimer::Stage lut, cvtColor, denoise, inRange, threshold, pyramid,
+            opening, contours, pose, udp, queue, publish, flush, draw, handoff;
+    } stages;
+
+    cv::Mat hsvThresholdInput;
+    cv::Mat hsv_image;
+    cv::Mat hsvThresholdOutput;
+    cv::Mat rawMask;
+    cv::Mat maskSum;
+    cv::Mat blurOutput;
+    cv::Mat findContoursOutput;
+    cv::Mat openingOutput;
+    cv::Mat contourOutput;
+
+    // The images above are windows the size of the area being searched,
+    // cut out of these, which only ever grow (see FitWindow)
+    cv::Mat gammaStorage, hsvStorage, blurStorage, maskStorage, rawMaskStorage,
+        openingStorage, coarsePairsStorage;
+
+    // YUYV frames converted to BGR while yuyvThreshold has no table yet
+    cv::Mat yuyvBgr, yuyvBgrStorage;
+
+    cv::Mat gammaTable;
+    double gammaTableGamma = 0.0;
+    cv::Mat openingKernel;
+    int openingKernelSize = 0;
+    cv::Mat drawing;
+
+    // Contours of every window searched this frame, and their approximations;
+    // the pools keep their memory from frame to frame
+    ContourFinder contourFinder;
+    ContourFinder coarseFinder;
+    PolygonApproximator approximator;
+    PolygonPool contours_poly;
+    cv::Mat coarsePairs;
+    cv::Mat coarseImage;
+    std::vector<cv::Rect> coarseWindows;
+    std::vector<cv::Point2f> centers;
+    std::vector<float> radius;
+
+    // Result of the last Detect(): the ranked cells and the nearest one
+    cv::Size frameSize;
+    cv::Rect searchArea;
+    std::vector<CellTarget> targets;
+    std::vector<CellTarget> previousTargets;
+    int largestContourID = 0;
+    double largestRadius = 0.0;
+    cv::Point2f largestCenter;
+    double horAngle = 0.0;
+    double vertAngle = 0.0;
+    double cellDistance = 0.0;
+    double cellX = 0.0;
+    double cellY = 0.0;
+
+    // ROI tracking state; trackedRadius is 0 while nothing is tracked
+    cv::Point2f trackedCenter;
+    float trackedRadius = 0.0f;
+    uint64_t trackedSequence = 0;
+    int framesSinceFullSearch = 0;
+
+    double alpha = 1.0; //Contrast control value
+    int beta = -40; //Brightness control value
+
+    // Whether the output stream has clients, kept up to date from cscore's
+    // notifier thread and checked once a second; the listener goes first on
+    // destruction
+    std::chrono::steady_clock::duration overlayPeriod{0};
+    std::chrono::steady_clock::time_point nextOverlay;
+    std::chrono::steady_clock::time_point nextStreamCheck;
+    std::atomic<bool> streamWatched{false};
+    cs::VideoListener streamListener;
+};
+
+}  // namespace dragonvision
@@ -0,0 +1,187 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "CellPipelineTuner.h"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include <networktables/NetworkTableInstance.h>
+#include <wpi/raw_ostream.h>
+
+#include "VisionConfig.h"
+
+using namespace dragonvision;
+
+namespace {
+
+using Settings = CellPipelineSettings;
+using Knob = CellPipelineTuner::Knob;
+
+// A number kept in field(settings), accepted within [min, max]; whole
+// numbers only for integer fields, odd ones only if odd is set
+template <typename Field>
+Knob NumberKnob(const char* key, Field field, double min, double max,
+                bool odd = false) {
+  return {key,
+          [field](const Settings& settings) {
+            return nt::Value::MakeDouble(field(settings));
+          },
+          [field, min, max, odd](const nt::Value& value, Settings& settings) {
+            using T = std::decay_t<decltype(field(settings))>;
+            if (!value.IsDouble()) return false;
+            double number = value.GetDouble();
+            if (!(number >= min && number <= max)) return false;
+            if (std::is_integral<T>::value) {
+              if (number != std::floor(number)) return false;
+              if (odd && static_cast<long>(number) % 2 == 0) return false;
+            }
+            field(settings) = static_cast<T>(number);
+            return true;
+          }};
+}
+
+template <typename Field>
+Knob BoolKnob(const char* key, Field field) {
+  return {key,
+          [field](const Settings& settings) {
+            return nt::Value::MakeBoolean(field(settings));
+          },
+          [field](const nt::Value& value, Settings& settings) {
+            if (!value.IsBoolean()) return false;
+            field(settings) = value.GetBoolean();
+            return true;
+          }};
+}
+
+// One of the names VisionConfig reads for field
+template <typename Field, typename T>
+Knob ChoiceKnob(const char* key, Field field,
+                bool (*parse)(wpi::StringRef, T&), const char* (*name)(T)) {
+  return {key,
+          [field, name](const Settings& settings) {
+            return nt::Value::MakeString(name(field(settings)));
+          },
+          [field, parse](const nt::Value& value, Settings& settings) {
+            return value.IsString() &&
+                   parse(value.GetString(), field(settings));
+          }};
+}
+
+// One channel of an HSV bound
+template <typename Field>
+Knob HsvKnob(const char* key, Field field, int channel) {
+  return NumberKnob(
+      key,
+      [field, channel](auto& settings) -> auto& {
+        return field(settings)[channel];
+      },
+      0.0, kHsvMax[channel]);
+}
+
+std::vector<Knob> MakeKnobs() {
+  auto hsvLow = [](auto& s) -> auto& { return s.color.hsvLow; };
+  auto hsvHigh = [](auto& s) -> auto& { return s.color.hsvHigh; };
+  return {
+      NumberKnob("gamma", [](auto& s) -> auto& { return s.color.gamma; },
+                 0.01, 10.0),
+      HsvKnob("hueLow", hsvLow, 0),
+      HsvKnob("saturationLow", hsvLow, 1),
+      HsvKnob("valueLow", hsvLow, 2),
+      HsvKnob("hueHigh", hsvHigh, 0),
+      HsvKnob("saturationHigh", hsvHigh, 1),
+      HsvKnob("valueHigh", hsvHigh, 2),
+      ChoiceKnob("threshold", [](auto& s) -> auto& { return s.threshold; },
+                 ParseThresholdMethod, ThresholdMethodName),
+      ChoiceKnob("denoise", [](auto& s) -> auto& { return s.denoise; },
+                 ParseDenoiseMethod, DenoiseMethodName),
+      NumberKnob("blurSize", [](auto& s) -> auto& { return s.blurSize; }, 1,
+                 Settings::kMaxKernelSize, true),
+      NumberKnob("openingSize", [](auto& s) -> auto& { return s.openingSize; },
+                 1, Settings::kMaxKernelSize, true),
+      NumberKnob("maxCellRadius",
+                 [](auto& s) -> auto& { return s.maxCellRadius; }, 1.0,
+                 10000.0),
+      BoolKnob("pose", [](auto& s) -> auto& { return s.pose; }),
+      NumberKnob("poseBudgetUs",
+                 [](auto& s) -> auto& { return s.poseBudgetUs; }, 0.0, 1e6),
+      NumberKnob("poseMaxError",
+                 [](auto& s) -> auto& { return s.poseMaxError; }, 0.0, 1000.0),
+      BoolKnob("roiTracking", [](auto& s) -> auto& { return s.roiTracking; }),
+      NumberKnob("roiRadiusScale",
+                 [](auto& s) -> auto& { return s.roiRadiusScale; }, 0.0,
+                 100.0),
+      NumberKnob("roiMotion", [](auto& s) -> auto& { return s.roiMotion; },
+                 0.0, 10000.0),
+      NumberKnob("roiFullFrameInterval",
+                 [](auto& s) -> auto& { return s.roiFullFrameInterval; }, 0,
+                 1e6),
+      NumberKnob("pyramidLevels",
+                 [](auto& s) -> auto& { return s.pyramidLevels; }, 0,
+                 Settings::kMaxPyramidLevels),
+      ChoiceKnob("rankBy", [](auto& s) -> auto& { return s.rankBy; },
+                 ParseRankBy, RankByName),
+      NumberKnob("maxTargets", [](auto& s) -> auto& { return s.maxTargets; },
+                 0, 1000),
+      NumberKnob("overlayFps", [](auto& s) -> auto& { return s.overlayFps; },
+                 0.0, 1000.0),
+  };
+}
+
+}  // namespace
+
+CellPipelineTuner::CellPipelineTuner(
+    std::shared_ptr<nt::NetworkTable> table,
+    std::shared_ptr<const CellPipelineSettings> settings)
+    : m_table(std::move(table)),
+      m_knobs(MakeKnobs()),
+      m_settings(std::move(settings)) {
+  // The config is the starting point on every run, whatever the server kept
+  for (const auto& knob : m_knobs) {
+    m_table->GetEntry(knob.key).ForceSetValue(knob.get(*m_settings));
+  }
+  m_listener = m_table->AddEntryListener(
+      [this](nt::NetworkTable*, wpi::StringRef key, nt::NetworkTableEntry,
+             std::shared_ptr<nt::Value> value,
+             int) { OnChange(key, value); },
+      NT_NOTIFY_NEW | NT_NOTIFY_UPDATE | NT_NOTIFY_LOCAL);
+}
+
+CellPipelineTuner::~CellPipelineTuner() {
+  m_table->RemoveEntryListener(m_listener);
+  // A callback already on its way could still reach this object
+  m_table->GetInstance().WaitForEntryListenerQueue(1.0);
+}
+
+bool CellPipelineTuner::Update(
+    std::shared_ptr<const CellPipelineSettings>& settings) {
+  uint64_t version = m_version.load(std::memory_order_acquire);
+  if (version == m_readVersion) return false;
+  settings = std::atomic_load(&m_settings);
+  m_readVersion = version;
+  return true;
+}
+
+void CellPipelineTuner::OnChange(wpi::StringRef key,
+                                 const std::shared_ptr<nt::Value>& value) {
+  auto knob = std::find_if(m_knobs.begin(), m_knobs.end(),
+                           [&](const Knob& k) { return key == k.key; });
+  if (knob == m_knobs.end() || !value) return;
+
+  std::scoped_lock lock(m_mutex);
+  auto current = std::atomic_load(&m_settings);
+  auto old = knob->get(*current);
+  if (*value == *old) return;  // our own write, or no change
+
+  auto next = std::make_shared<CellPipelineSettings>(*current);
+  if (!knob->set(*value, *next)) {
+    wpi::errs() << "ignoring invalid tuning value for " << key << '\n';
+    m_table->GetEntry(key).ForceSetValue(old);
+    return;
+  }
+  std::atomic_store(
+      &m_settings, std::shared_ptr<const CellPipelineSettings>(std::move(next)));
+  m_version.fetch_add(1, std::memory_order_release);
+}
@@ -0,0 +1,85 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <networktables/NetworkTable.h>
+#include <networktables/NetworkTableValue.h>
+
+#include "CellPipeline.h"
+
+namespace dragonvision {
+
+/**
+ * Publishes the tunable CellPipelineSettings as entries of a NetworkTables
+ * table ("gamma", "hueLow", "blurSize", "threshold", ...) and turns changes
+ * to them into new settings snapshots.
+ *
+ * Changes arrive on NetworkTables' listener thread. Each valid one is
+ * applied to a copy of the current snapshot, which is then swapped in with
+ * std::atomic_store; invalid ones are reported and the entry is put back.
+ * The vision thread calls Update() once a frame, which costs one atomic
+ * load while nothing has changed and never touches NetworkTables.
+ *
+ * The settings that size threads, sockets or tables when the pipeline is
+ * built (lut bits, udp, perf rate, latency) and the camera model (camera,
+ * angle table, mount) are config only.
+ */
+class CellPipelineTuner {
+ public:
+  /**
+   * @param table    where the entries are published
+   * @param settings the starting snapshot
+   */
+  CellPipelineTuner(std::shared_ptr<nt::NetworkTable> table,
+                    std::shared_ptr<const CellPipelineSettings> settings);
+  ~CellPipelineTuner();
+
+  CellPipelineTuner(const CellPipelineTuner&) = delete;
+  CellPipelineTuner& operator=(const CellPipelineTuner&) = delete;
+
+  /**
+   * Replaces settings with the latest snapshot if it is newer than the one
+   * last returned. Only one thread may call this.
+   *
+   * @return true if settings was replaced
+   */
+  bool Update(std::shared_ptr<const CellPipelineSettings>& settings);
+
+  /** Number of changes applied so far. */
+  uint64_t GetVersion() const { return m_version; }
+
+  /** One tunable setting and its entry. */
+  struct Knob {
+    std::string key;
+    std::function<std::shared_ptr<nt::Value>(const CellPipelineSettings&)>
+        get;
+    // false if value is the wrong type or out of range
+    std::function<bool(const nt::Value&, CellPipelineSettings&)> set;
+  };
+
+ private:
+  void OnChange(wpi::StringRef key, const std::shared_ptr<nt::Value>& value);
+
+  std::shared_ptr<nt::NetworkTable> m_table;
+  std::vector<Knob> m_knobs;
+  NT_EntryListener m_listener = 0;
+
+  // Serializes writers; the vision thread never takes it
+  std::mutex m_mutex;
+  // Read and replaced with std::atomic_load / std::atomic_store only
+  std::shared_ptr<const CellPipelineSettings> m_settings;
+  std::atomic<uint64_t> m_version{0};
+  uint64_t m_readVersion = 0;  // vision thread only
+};
+
+}  // namespace dragonvision
@@ -0,0 +1,449 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "ColorThreshold.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/core/hal/intrin.hpp>
+#include <opencv2/imgproc.hpp>
+
+using namespace dragonvision;
+
+cv::Mat dragonvision::MakeGammaTable(double gamma) {
+  cv::Mat lookUpTable(1, 256, CV_8U);
+  uchar* p = lookUpTable.ptr();
+  for (int i = 0; i < 256; ++i) {
+    p[i] = cv::saturate_cast<uchar>(std::pow(i / 255.0, gamma) * 255.0);
+  }
+  return lookUpTable;
+}
+
+void dragonvision::ThresholdBgr(const cv::Mat& bgr, const cv::Mat& gammaTable,
+                                const ColorThresholdParams& params,
+                                cv::Mat& gammaScratch, cv::Mat& hsvScratch,
+                                cv::Mat& mask) {
+  cv::LUT(bgr, gammaTable, gammaScratch);
+  cv::cvtColor(gammaScratch, hsvScratch, cv::COLOR_BGR2HSV);
+  cv::inRange(hsvScratch, params.hsvLow, params.hsvHigh, mask);
+}
+
+void dragonvision::MajorityFilter(const cv::Mat& mask, int ksize,
+                                  cv::Mat& sumScratch, cv::Mat& out) {
+  CV_Assert(mask.type() == CV_8U && ksize > 0 && ksize % 2 == 1 &&
+            ksize * ksize < 65536 && out.data != mask.data);
+  int r = ksize / 2;
+  int rows = mask.rows;
+  int cols = mask.cols;
+  int majority = (ksize * ksize + 1) / 2;
+  out.create(mask.size(), CV_8U);
+
+  // Count of set pixels per column over the ksize rows around the current
+  // one, padded by r + 1 on both sides for the horizontal window. cv::
+  // boxFilter did this with a filter engine set up (and allocated) per call.
+  // The scratch only grows, so narrower masks reuse it.
+  if (sumScratch.type() != CV_16U || sumScratch.total() < cols + 2 * r + 2u) {
+    sumScratch.create(1, cols + 2 * r + 2, CV_16U);
+  }
+  uint16_t* colSum = sumScratch.ptr<uint16_t>() + r + 1;
+  auto row = [&](int y) { return mask.ptr(std::clamp(y, 0, rows - 1)); };
+  std::fill_n(colSum, cols, 0);
+  for (int dy = -r; dy <= r; ++dy) {
+    const uchar* src = row(dy);
+    for (int x = 0; x < cols; ++x) colSum[x] += src[x] != 0;
+  }
+
+  for (int y = 0; y < rows; ++y) {
+    if (y > 0) {
+      const uchar* add = row(y + r);
+      const uchar* sub = row(y - r - 1);
+      for (int x = 0; x < cols; ++x) {
+        colSum[x] += (add[x] != 0) - (sub[x] != 0);
+      }
+    }
+    // Replicated border, as medianBlur uses
+    std::fill(colSum - r - 1, colSum, colSum[0]);
+    std::fill(colSum + cols, colSum + cols + r + 1, colSum[cols - 1]);
+
+    uchar* dst = out.ptr(y);
+    int sum = 0;
+    for (int x = -r; x <= r; ++x) sum += colSum[x];
+    for (int x = 0; x < cols; ++x) {
+      dst[x] = sum >= majority ? 255 : 0;
+      sum += colSum[x + r + 1] - colSum[x - r];
+    }
+  }
+}
+
+ThresholdTableBuilder::ThresholdTableBuilder(MakeBits makeBits)
+    : m_makeBits(std::move(makeBits)) {}
+
+ThresholdTableBuilder::~ThresholdTableBuilder() {
+  {
+    std::scoped_lock lock(m_mutex);
+    m_stop = true;
+  }
+  m_wake.notify_one();
+  if (m_builder.joinable()) m_builder.join();
+}
+
+void ThresholdTableBuilder::SetParams(const ColorThresholdParams& params) {
+  {
+    std::scoped_lock lock(m_mutex);
+    if (m_hasRequest && m_requested == params) return;
+    m_requested = params;
+    m_hasRequest = true;
+    m_pending = true;
+    if (!m_builder.joinable()) m_builder = std::thread([this] { BuildLoop(); });
+  }
+  m_wake.notify_one();
+}
+
+void ThresholdTableBuilder::BuildLoop() {
+  std::unique_lock lock(m_mutex);
+  for (;;) {
+    m_wake.wait(lock, [this] { return m_pending || m_stop; });
+    if (m_stop) return;
+    ColorThresholdParams params = m_requested;
+    m_pending = false;
+
+    // A request that arrives during the build is picked up by the next pass
+    lock.unlock();
+    auto table = MakeTable(params);
+    std::atomic_store(&m_table, table);
+    lock.lock();
+  }
+}
+
+void ThresholdTableBuilder::Build(const ColorThresholdParams& params) {
+  std::atomic_store(&m_table, MakeTable(params));
+}
+
+std::shared_ptr<const ThresholdTableBuilder::Table>
+ThresholdTableBuilder::MakeTable(const ColorThresholdParams& params) const {
+  auto table = std::make_shared<Table>();
+  table->params = params;
+  table->bits = m_makeBits(params);
+  return table;
+}
+
+BgrThresholdLut::BgrThresholdLut(int bitsPerChannel)
+    : m_bitsPerChannel(std::clamp(bitsPerChannel, kMinBitsPerChannel, 8)),
+      m_builder([this](const ColorThresholdParams& params) {
+        return MakeBits(params);
+      }) {}
+
+void BgrThresholdLut::SetParams(const ColorThresholdParams& params) {
+  m_builder.SetParams(params);
+}
+
+void BgrThresholdLut::Build(const ColorThresholdParams& params) {
+  m_builder.Build(params);
+}
+
+bool BgrThresholdLut::IsBuilt() const {
+  return m_builder.GetTable() != nullptr;
+}
+
+ColorThresholdParams BgrThresholdLut::GetParams() const {
+  auto table = m_builder.GetTable();
+  return table ? table->params : ColorThresholdParams{};
+}
+
+std::vector<uint8_t> BgrThresholdLut::MakeBits(
+    const ColorThresholdParams& params) const {
+  const int n = m_bitsPerChannel;
+  const int size = 1 << n;
+  const int shift = 8 - n;
+  // Quantized cells are represented by their center value
+  const int half = shift > 0 ? 1 << (shift - 1) : 0;
+
+  std::vector<uint8_t> bits((1 << (3 * n)) >> 3, 0);
+
+  FusedColorThreshold fused;
+  fused.SetParams(params);
+
+  // One row of every quantized R value per (B, G) pair
+  std::vector<uchar> row(3 * size);
+  std::vector<uchar> mask(size);
+  for (int b = 0; b < size; ++b) {
+    for (int g = 0; g < size; ++g) {
+      for (int r = 0; r < size; ++r) {
+        row[3 * r + 0] = (b << shift) | half;
+        row[3 * r + 1] = (g << shift) | half;
+        row[3 * r + 2] = (r << shift) | half;
+      }
+      fused.ApplyRow(row.data(), mask.data(), size);
+
+      int base = (b << (2 * n)) | (g << n);
+      for (int r = 0; r < size; ++r) {
+        if (mask[r]) bits[(base | r) >> 3] |= 1 << (r & 7);
+      }
+    }
+  }
+  return bits;
+}
+
+bool BgrThresholdLut::Apply(const cv::Mat& bgr, cv::Mat& mask) const {
+  CV_Assert(bgr.type() == CV_8UC3);
+  auto table = m_builder.GetTable();
+  if (!table) return false;
+  mask.create(bgr.rows, bgr.cols, CV_8U);
+
+  const uint8_t* bits = table->bits.data();
+  const int n = m_bitsPerChannel;
+  const int shift = 8 - n;
+  for (int r = 0; r < bgr.rows; ++r) {
+    const uchar* in = bgr.ptr<uchar>(r);
+    uchar* out = mask.ptr<uchar>(r);
+    for (int c = 0; c < bgr.cols; ++c, in += 3) {
+      unsigned index = ((in[0] >> shift) << (2 * n)) |
+                       ((in[1] >> shift) << n) | (in[2] >> shift);
+      out[c] = -((bits[index >> 3] >> (index & 7)) & 1);
+    }
+  }
+  return true;
+}
+
+YuyvThresholdTable::YuyvThresholdTable() : m_builder(MakeBits) {}
+
+void YuyvThresholdTable::SetParams(const ColorThresholdParams& params) {
+  m_builder.SetParams(params);
+}
+
+void YuyvThresholdTable::Build(const ColorThresholdParams& params) {
+  m_builder.Build(params);
+}
+
+bool YuyvThresholdTable::IsBuilt() const {
+  return m_builder.GetTable() != nullptr;
+}
+
+ColorThresholdParams YuyvThresholdTable::GetParams() const {
+  auto table = m_builder.GetTable();
+  return table ? table->params : ColorThresholdParams{};
+}
+
+std::vector<uint8_t> YuyvThresholdTable::MakeBits(
+    const ColorThresholdParams& params) {
+  std::vector<uint8_t> bits(1 << 21, 0);
+  cv::Mat gammaTable = MakeGammaTable(params.gamma);
+
+  // One 256x256 YUYV image per U value: row is V, pixel pair column is Y.
+  // Each pair repeats the same Y, so every pixel is one (Y, U, V) triple.
+  cv::Mat yuyv(256, 512, CV_8UC2);
+  cv::Mat bgr, gammaScratch, hsv, mask;
+  for (int u = 0; u < 256; ++u) {
+    for (int v = 0; v < 256; ++v) {
+      auto row = yuyv.ptr<uchar>(v);
+      for (int y = 0; y < 256; ++y) {
+        row[4 * y + 0] = y;
+        row[4 * y + 1] = u;
+        row[4 * y + 2] = y;
+        row[4 * y + 3] = v;
+      }
+    }
+    cv::cvtColor(yuyv, bgr, cv::COLOR_YUV2BGR_YUYV);
+    ThresholdBgr(bgr, gammaTable, params, gammaScratch, hsv, mask);
+
+    for (int v = 0; v < 256; ++v) {
+      auto row = mask.ptr<uchar>(v);
+      uint8_t* out = &bits[((u << 16) | (v << 8)) >> 3];
+      for (int y = 0; y < 256; ++y) {
+        if (row[2 * y]) out[y >> 3] |= 1 << (y & 7);
+      }
+    }
+  }
+
+  return bits;
+}
+
+bool YuyvThresholdTable::Apply(const cv::Mat& yuyv, cv::Mat& mask) const {
+  CV_Assert(yuyv.type() == CV_8UC2 && (yuyv.cols & 1) == 0);
+  auto table = m_builder.GetTable();
+  if (!table) return false;
+  mask.create(yuyv.rows, yuyv.cols, CV_8U);
+
+  const uint8_t* bits = table->bits.data();
+  for (int r = 0; r < yuyv.rows; ++r) {
+    const uchar* in = yuyv.ptr<uchar>(r);
+    uchar* out = mask.ptr<uchar>(r);
+    for (int c = 0; c < yuyv.cols; c += 2, in += 4) {
+      const uint8_t* run = bits + (((in[1] << 16) | (in[3] << 8)) >> 3);
+      out[c] = -((run[in[0] >> 3] >> (in[0] & 7)) & 1);
+      out[c + 1] = -((run[in[2] >> 3] >> (in[2] & 7)) & 1);
+    }
+  }
+  return true;
+}
+
+namespace {
+
+  // OpenCV's BGR2HSV_b fixed point tables: 12 fractional bits, hue range 180
+  constexpr int kHsvShift = 12;
+
+  struct HsvDivTables {
+    int sdiv[256];
+    int hdiv[256];
+
+    HsvDivTables() {
+      sdiv[0] = hdiv[0] = 0;
+      for (int i = 1; i < 256; i++) {
+        sdiv[i] = cv::saturate_cast<int>((255 << kHsvShift) / (1. * i));
+        hdiv[i] = cv::saturate_cast<int>((180 << kHsvShift) / (6. * i));
+      }
+    }
+  };
+
+  const HsvDivTables& DivTables() {
+    static const HsvDivTables tables;
+    return tables;
+  }
+
+}  // namespace
+
+void FusedColorThreshold::SetParams(const ColorThresholdParams& params) {
+  m_params = params;
+
+  auto gammaTable = MakeGammaTable(params.gamma);
+  std::copy(gammaTable.ptr<uchar>(), gammaTable.ptr<uchar>() + 256, m_gamma);
+
+  // inRange converts double bounds to int with rounding and turns an
+  // inverted or out of range pair into an empty range
+  m_empty = false;
+  for (int k = 0; k < 3; ++k) {
+    int lo = cvRound(params.hsvLow[k]);
+    int hi = cvRound(params.hsvHigh[k]);
+    if (lo > hi || lo > 255 || hi < 0) m_empty = true;
+    m_low[k] = std::max(lo, 0);
+    m_high[k] = std::min(hi, 255);
+  }
+}
+
+void FusedColorThreshold::Apply(const cv::Mat& bgr, cv::Mat& mask) const {
+  CV_Assert(bgr.type() == CV_8UC3);
+  mask.create(bgr.rows, bgr.cols, CV_8U);
+  for (int r = 0; r < bgr.rows; ++r)
+    ApplyRow(bgr.ptr<uchar>(r), mask.ptr<uchar>(r), bgr.cols);
+}
+
+void FusedColorThreshold::ApplyScalar(const cv::Mat& bgr, cv::Mat& mask) const {
+  CV_Assert(bgr.type() == CV_8UC3);
+  mask.create(bgr.rows, bgr.cols, CV_8U);
+  for (int r = 0; r < bgr.rows; ++r)
+    ApplyRowScalar(bgr.ptr<uchar>(r), mask.ptr<uchar>(r), bgr.cols);
+}
+
+void FusedColorThreshold::ApplyRowScalar(const uchar* bgr, uchar* mask,
+                                         int n) const {
+  if (m_empty) {
+    std::fill(mask, mask + n, 0);
+    return;
+  }
+  const auto& div = DivTables();
+  for (int i = 0; i < n; ++i, bgr += 3) {
+    int b = m_gamma[bgr[0]], g = m_gamma[bgr[1]], r = m_gamma[bgr[2]];
+    int v = std::max(b, std::max(g, r));
+    int vmin = std::min(b, std::min(g, r));
+    int diff = v - vmin;
+    int vr = v == r ? -1 : 0;
+    int vg = v == g ? -1 : 0;
+
+    int s = (diff * div.sdiv[v] + (1 << (kHsvShift - 1))) >> kHsvShift;
+    int h = (vr & (g - b)) +
+            (~vr & ((vg & (b - r + 2 * diff)) + ((~vg) & (r - g + 4 * diff))));
+    h = (h * div.hdiv[diff] + (1 << (kHsvShift - 1))) >> kHsvShift;
+    h += h < 0 ? 180 : 0;
+
+    bool in = h >= m_low[0] && h <= m_high[0] && s >= m_low[1] &&
+              s <= m_high[1] && v >= m_low[2] && v <= m_high[2];
+    mask[i] = in ? 255 : 0;
+  }
+}
+
+void FusedColorThreshold::ApplyRow(const uchar* bgr, uchar* mask,
+                                   int n) const {
+  int i = 0;
+#if CV_SIMD128
+  if (!m_empty) {
+    using namespace cv;
+    constexpr int kLanes = v_uint8x16::nlanes;
+    const auto& div = DivTables();
+    const v_uint8x16 vLow = v_setall_u8(m_low[2]), vHigh = v_setall_u8(m_high[2]);
+    const v_int32x4 hLow = v_setall_s32(m_low[0]), hHigh = v_setall_s32(m_high[0]);
+    const v_int32x4 sLow = v_setall_s32(m_low[1]), sHigh = v_setall_s32(m_high[1]);
+    const v_int32x4 half = v_setall_s32(1 << (kHsvShift - 1));
+    const v_int32x4 hueRange = v_setall_s32(180);
+    uchar CV_DECL_ALIGNED(16) corrected[3 * kLanes];
+    int CV_DECL_ALIGNED(16) vIdx[kLanes];
+    int CV_DECL_ALIGNED(16) diffIdx[kLanes];
+
+    for (; i <= n - kLanes; i += kLanes, bgr += 3 * kLanes) {
+      // gamma is a 256 entry gather, cheapest done scalar into an L1 buffer
+      for (int k = 0; k < 3 * kLanes; ++k) corrected[k] = m_gamma[bgr[k]];
+      v_uint8x16 b, g, r;
+      v_load_deinterleave(corrected, b, g, r);
+
+      v_uint8x16 v = v_max(b, v_max(g, r));
+      v_uint8x16 inV = (v >= vLow) & (v <= vHigh);
+      if (!v_check_any(inV)) {
+        v_store(mask + i, v_setzero_u8());
+        continue;
+      }
+      v_uint8x16 diff = v - v_min(b, v_min(g, r));
+      v_int8x16 vr = v_reinterpret_as_s8(v == r);
+      v_int8x16 vg = v_reinterpret_as_s8(v == g);
+
+      // hue numerator in 16 bits: same select as the scalar code
+      v_uint16x8 b16[2], g16[2], r16[2], d16[2], v16[2];
+      v_int16x8 vr16[2], vg16[2];
+      v_expand(b, b16[0], b16[1]);
+      v_expand(g, g16[0], g16[1]);
+      v_expand(r, r16[0], r16[1]);
+      v_expand(diff, d16[0], d16[1]);
+      v_expand(v, v16[0], v16[1]);
+      v_expand(vr, vr16[0], vr16[1]);
+      v_expand(vg, vg16[0], vg16[1]);
+
+      v_int32x4 inHS[4];
+      for (int half16 = 0; half16 < 2; ++half16) {
+        v_int16x8 bs = v_reinterpret_as_s16(b16[half16]);
+        v_int16x8 gs = v_reinterpret_as_s16(g16[half16]);
+        v_int16x8 rs = v_reinterpret_as_s16(r16[half16]);
+        v_int16x8 ds = v_reinterpret_as_s16(d16[half16]);
+        v_int16x8 hnum =
+            (vr16[half16] & v_sub_wrap(gs, bs)) +
+            (~vr16[half16] &
+             ((vg16[half16] & (bs - rs + ds + ds)) +
+              (~vg16[half16] & (rs - gs + (ds << 2)))));
+
+        v_int32x4 hn[2], d32[2], v32[2];
+        v_expand(hnum, hn[0], hn[1]);
+        v_expand(ds, d32[0], d32[1]);
+        v_expand(v_reinterpret_as_s16(v16[half16]), v32[0], v32[1]);
+
+        for (int q = 0; q < 2; ++q) {
+          v_store_aligned(vIdx + 4 * q, v32[q]);
+          v_store_aligned(diffIdx + 4 * q, d32[q]);
+        }
+        for (int q = 0; q < 2; ++q) {
+          v_int32x4 sdiv = v_lut(div.sdiv, vIdx + 4 * q);
+          v_int32x4 hdiv = v_lut(div.hdiv, diffIdx + 4 * q);
+          v_int32x4 s = (d32[q] * sdiv + half) >> kHsvShift;
+          v_int32x4 h = (hn[q] * hdiv + half) >> kHsvShift;
+          h += hueRange & (h < v_setzero_s32());
+          inHS[2 * half16 + q] = v_reinterpret_as_s32(
+              (h >= hLow) & (h <= hHigh) & (s >= sLow) & (s <= sHigh));
+        }
+      }
+
+      // -1/0 lanes survive saturating packs unchanged
+      v_int8x16 inHS8 = v_pack(v_pack(inHS[0], inHS[1]), v_pack(inHS[2], inHS[3]));
+      v_store(mask + i, inV & v_reinterpret_as_u8(inHS8));
+    }
+  }
+#endif
+  ApplyRowScalar(bgr, mask + i, n - i);
+}
@@ -0,0 +1,263 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace dragonvision {
+
+/**
+ * Parameters of the gamma -> HSV -> inRange color threshold.
+ */
+struct ColorThresholdParams {
+  double gamma = 0.9;
+  cv::Scalar hsvLow{5.0, 125.0, 50.0};
+  cv::Scalar hsvHigh{50.0, 255.0, 255.0};
+
+  bool operator==(const ColorThresholdParams& other) const {
+    return gamma == other.gamma && hsvLow == other.hsvLow &&
+           hsvHigh == other.hsvHigh;
+  }
+  bool operator!=(const ColorThresholdParams& other) const {
+    return !(*this == other);
+  }
+};
+
+/**
+ * Builds the 256-entry gamma correction table used with cv::LUT.
+ */
+cv::Mat MakeGammaTable(double gamma);
+
+/**
+ * Thresholds a BGR image the way CellPipeline always has: gamma LUT,
+ * BGR2HSV, inRange. Scratch images are reused between calls.
+ */
+void ThresholdBgr(const cv::Mat& bgr, const cv::Mat& gammaTable,
+                  const ColorThresholdParams& params, cv::Mat& gammaScratch,
+                  cv::Mat& hsvScratch, cv::Mat& mask);
+
+/**
+ * Majority vote over a ksize x ksize window of a 0/255 mask: a pixel is set
+ * when more than half of its window is. For a binary mask this is exactly
+ * what cv::medianBlur computes (with the same replicated border), but it is
+ * done with running row and column counts instead of a median. It does not
+ * allocate once out has its size and sumScratch has been used for a mask at
+ * least as wide. out must not be mask.
+ */
+void MajorityFilter(const cv::Mat& mask, int ksize, cv::Mat& sumScratch,
+                    cv::Mat& out);
+
+/**
+ * Single-pass version of ThresholdBgr(): reads each BGR pixel once and writes
+ * one mask byte, with no gamma or HSV image in between.
+ *
+ * The HSV conversion reproduces OpenCV's 8-bit BGR2HSV integer arithmetic
+ * (including its division tables) and the bounds are rounded the way inRange
+ * rounds them, so the mask is bit-exact with ThresholdBgr(). Where OpenCV's
+ * universal intrinsics are available (NEON on the Pi, SSE2 on a desktop) 16
+ * pixels are processed per step; otherwise a scalar loop is used.
+ */
+class FusedColorThreshold {
+ public:
+  void SetParams(const ColorThresholdParams& params);
+  const ColorThresholdParams& GetParams() const { return m_params; }
+
+  /**
+   * Thresholds a CV_8UC3 BGR image into a CV_8U 0/255 mask of the same size.
+   */
+  void Apply(const cv::Mat& bgr, cv::Mat& mask) const;
+
+  /**
+   * Same as Apply() but never uses the SIMD path; for verification.
+   */
+  void ApplyScalar(const cv::Mat& bgr, cv::Mat& mask) const;
+
+  /**
+   * Thresholds n pixels of one row.
+   */
+  void ApplyRow(const uchar* bgr, uchar* mask, int n) const;
+  void ApplyRowScalar(const uchar* bgr, uchar* mask, int n) const;
+
+ private:
+  ColorThresholdParams m_params;
+  bool m_empty = true;  // some bound is an empty range; nothing matches
+  uchar m_gamma[256];
+  int m_low[3];   // h, s, v
+  int m_high[3];
+};
+
+/**
+ * Keeps the current bit table of a table driven color threshold and builds
+ * new ones on a background thread.
+ *
+ * SetParams() hands the build to the thread and returns; the table is swapped
+ * in atomically once it is complete, so readers never wait for a rebuild and
+ * keep using the previous table until then. The thread is started by the
+ * first request and stopped on destruction, before the owner's other members
+ * go if it is declared last.
+ */
+class ThresholdTableBuilder {
+ public:
+  struct Table {
+    ColorThresholdParams params;
+    std::vector<uint8_t> bits;
+  };
+
+  /** Computes the bits of the table for params; called on either thread. */
+  using MakeBits =
+      std::function<std::vector<uint8_t>(const ColorThresholdParams&)>;
+
+  explicit ThresholdTableBuilder(MakeBits makeBits);
+  ~ThresholdTableBuilder();
+
+  ThresholdTableBuilder(const ThresholdTableBuilder&) = delete;
+  ThresholdTableBuilder& operator=(const ThresholdTableBuilder&) = delete;
+
+  /**
+   * Requests a table for params. Returns immediately; a request for the
+   * params last requested does nothing.
+   */
+  void SetParams(const ColorThresholdParams& params);
+
+  /** Builds a table for params on the calling thread and swaps it in. */
+  void Build(const ColorThresholdParams& params);
+
+  /** The newest complete table; null until one is built. */
+  std::shared_ptr<const Table> GetTable() const {
+    return std::atomic_load(&m_table);
+  }
+
+ private:
+  std::shared_ptr<const Table> MakeTable(
+      const ColorThresholdParams& params) const;
+  void BuildLoop();
+
+  MakeBits m_makeBits;
+
+  // Read and replaced with std::atomic_load / std::atomic_store only
+  std::shared_ptr<const Table> m_table;
+
+  // Rebuild requests, protected by m_mutex
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  ColorThresholdParams m_requested;
+  bool m_hasRequest = false;
+  bool m_pending = false;
+  bool m_stop = false;
+  std::thread m_builder;
+};
+
+/**
+ * Color threshold as a bit table over the BGR cube: per pixel, Apply() does
+ * one lookup instead of any gamma or HSV arithmetic.
+ *
+ * Each channel is quantized to bitsPerChannel bits. With 8 bits the table
+ * holds all 2^24 BGR values (2 MiB) and is bit-exact with ThresholdBgr();
+ * fewer bits give a smaller, more cache friendly table (6 bits is 32 KiB) at
+ * the cost of pixels near a bound, which take the value of their cell center.
+ *
+ * SetParams() rebuilds the table on a background thread and swaps it in
+ * atomically once it is complete, so Apply() never waits for a rebuild; until
+ * then it keeps using the previous table. See ThresholdTableBuilder.
+ */
+class BgrThresholdLut {
+ public:
+  static constexpr int kDefaultBitsPerChannel = 8;
+  static constexpr int kMinBitsPerChannel = 5;
+
+  explicit BgrThresholdLut(int bitsPerChannel = kDefaultBitsPerChannel);
+
+  BgrThresholdLut(const BgrThresholdLut&) = delete;
+  BgrThresholdLut& operator=(const BgrThresholdLut&) = delete;
+
+  /**
+   * Requests a table for params. Returns immediately; cheap to call every
+   * frame when params have not changed.
+   */
+  void SetParams(const ColorThresholdParams& params);
+
+  /** Builds a table for params on the calling thread and swaps it in. */
+  void Build(const ColorThresholdParams& params);
+
+  /** True once some table has been swapped in. */
+  bool IsBuilt() const;
+
+  /** Parameters of the table Apply() currently uses. */
+  ColorThresholdParams GetParams() const;
+
+  int GetBitsPerChannel() const { return m_bitsPerChannel; }
+
+  /**
+   * Thresholds a CV_8UC3 BGR image into a CV_8U 0/255 mask of the same size.
+   * Returns false, leaving mask untouched, if no table has been built yet.
+   */
+  bool Apply(const cv::Mat& bgr, cv::Mat& mask) const;
+
+ private:
+  // Bit (b << 2n | g << n | r) for n bits per channel
+  std::vector<uint8_t> MakeBits(const ColorThresholdParams& params) const;
+
+  const int m_bitsPerChannel;
+  ThresholdTableBuilder m_builder;
+};
+
+/**
+ * Color threshold that works directly on packed YUYV (YUY2) frames.
+ *
+ * Build() pushes every (Y, U, V) triple through the same cvtColor / LUT /
+ * cvtColor / inRange calls that the BGR path uses and stores the result as
+ * one bit, so Apply() produces exactly the mask the BGR chain would have
+ * produced from cscore's YUYV to BGR conversion, without ever materializing
+ * the BGR or HSV image.
+ *
+ * A build takes on the order of a second on a Pi, so like BgrThresholdLut,
+ * SetParams() builds the table on a background thread and swaps it in once
+ * it is complete; Apply() keeps using the previous table until then.
+ */
+class YuyvThresholdTable {
+ public:
+  YuyvThresholdTable();
+
+  YuyvThresholdTable(const YuyvThresholdTable&) = delete;
+  YuyvThresholdTable& operator=(const YuyvThresholdTable&) = delete;
+
+  /**
+   * Requests a table for params. Returns immediately; cheap to call when
+   * params have not changed.
+   */
+  void SetParams(const ColorThresholdParams& params);
+
+  /** Builds a table for params on the calling thread and swaps it in. */
+  void Build(const ColorThresholdParams& params);
+
+  /** True once some table has been swapped in. */
+  bool IsBuilt() const;
+
+  /** Parameters of the table Apply() currently uses. */
+  ColorThresholdParams GetParams() const;
+
+  /**
+   * Thresholds a CV_8UC2 YUYV image into a CV_8U 0/255 mask of the same size.
+   * Returns false, leaving mask untouched, if no table has been built yet.
+   */
+  bool Apply(const cv::Mat& yuyv, cv::Mat& mask) const;
+
+ private:
+  // Bit (u << 16 | v << 8 | y). Both pixels of a YUYV pair share U and V, so
+  // their lookups land in the same 32-byte run of the table.
+  static std::vector<uint8_t> MakeBits(const ColorThresholdParams& params);
+
+  ThresholdTableBuilder m_builder;
+};
+
+}  // namespace dragonvision
@@ -0,0 +1,287 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "ContourFinder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+using namespace dragonvision;
+
+namespace {
+
+// Chain code directions, counterclockwise from east (y grows downwards)
+const cv::Point kCodeDeltas[8] = {{1, 0},  {1, -1}, {0, -1}, {-1, -1},
+                                  {-1, 0}, {-1, 1}, {0, 1},  {1, 1}};
+
+}  // namespace
+
+void ContourFinder::Find(const cv::Mat& mask, Mode mode, cv::Point offset) {
+  CV_Assert(mask.type() == CV_8UC1);
+
+  // Labels: 0 background, 1 unvisited foreground, +-(index + 2) for pixels
+  // on border index, negative where the border's right side is background.
+  // The one pixel frame of background stands in for OpenCV's padded copy.
+  int width = mask.cols + 2;
+  int height = mask.rows + 2;
+  m_step = width;
+  m_labels.resize(static_cast<size_t>(width) * height);
+  std::fill_n(m_labels.begin(), width, 0);
+  std::fill_n(m_labels.end() - width, width, 0);
+  for (int y = 0; y < mask.rows; ++y) {
+    const uchar* src = mask.ptr(y);
+    int* dst = &m_labels[static_cast<size_t>(y + 1) * width];
+    dst[0] = 0;
+    for (int x = 0; x < mask.cols; ++x) dst[x + 1] = src[x] != 0;
+    dst[width - 1] = 0;
+  }
+
+  m_borders.clear();
+  m_points.clear();
+  m_firstRoot = -1;
+  offset -= cv::Point(1, 1);
+
+  for (int y = 1; y < height - 1; ++y) {
+    int* row = &m_labels[static_cast<size_t>(y) * width];
+    int prev = 0;
+    int lnbd = 0;  // label of the last border passed on this row; 0 is frame
+    for (int x = 1; x < width - 1; ++x) {
+      int p = row[x];
+      if (p == prev) continue;
+
+      // An outer border starts at a fresh pixel with background to its left,
+      // a hole border at a foreground pixel with background to its right
+      bool hole;
+      if (prev == 0 && p == 1) {
+        hole = false;
+      } else if (p == 0 && prev >= 1) {
+        hole = true;
+      } else {
+        prev = p;
+        if (p != 0 && p != 1) lnbd = p;
+        continue;
+      }
+      if (mode == Mode::kExternal && (hole || lnbd > 0)) {
+        prev = p;
+        continue;
+      }
+
+      // Suzuki and Abe's table 1, with the frame as a hole border
+      int last = lnbd == 0 ? -1 : std::abs(lnbd) - 2;
+      bool lastHole = last < 0 || m_borders[last].hole;
+      int parent = last;
+      if (hole == lastHole) parent = last < 0 ? -1 : m_borders[last].parent;
+
+      int index = static_cast<int>(m_borders.size());
+      m_borders.push_back({parent, hole});
+      Border& border = m_borders.back();
+      border.begin = static_cast<int>(m_points.size());
+      int start = x - hole;
+      Follow(y * width + start, cv::Point(start, y) + offset, hole, index + 2);
+      border.end = static_cast<int>(m_points.size());
+
+      // Newest first among siblings, as cvInsertNodeIntoTree does
+      int& first = parent < 0 ? m_firstRoot : m_borders[parent].firstChild;
+      border.nextSibling = first;
+      first = index;
+
+      lnbd = row[start];
+      prev = row[x];
+    }
+  }
+
+  // Depth first, each border before its children, like cvTreeToNodeSeq
+  for (int b = m_firstRoot; b >= 0;) {
+    const Border& border = m_borders[b];
+    for (int i = border.begin; i < border.end; ++i) {
+      m_contours.Add(m_points[i]);
+    }
+    m_contours.EndPolygon();
+
+    if (border.firstChild >= 0) {
+      b = border.firstChild;
+      continue;
+    }
+    while (b >= 0 && m_borders[b].nextSibling < 0) b = m_borders[b].parent;
+    if (b >= 0) b = m_borders[b].nextSibling;
+  }
+}
+
+void ContourFinder::Follow(int start, cv::Point origin, bool hole,
+                           int label) {
+  // icvFetchContour for CHAIN_APPROX_SIMPLE: a point wherever the direction
+  // changes
+  int deltas[16];
+  for (int s = 0; s < 8; ++s) {
+    deltas[s] = deltas[s + 8] = kCodeDeltas[s].x + kCodeDeltas[s].y * m_step;
+  }
+  int* labels = m_labels.data();
+  cv::Point pt = origin;
+
+  int i0 = start;
+  int i1;
+  int sEnd = hole ? 0 : 4;
+  int s = sEnd;
+  do {
+    s = (s - 1) & 7;
+    i1 = i0 + deltas[s];
+  } while (labels[i1] == 0 && s != sEnd);
+
+  if (s == sEnd) {
+    // single pixel
+    labels[i0] = -label;
+    m_points.push_back(pt);
+    return;
+  }
+
+  int i3 = i0;
+  int i4;
+  int prevS = s ^ 4;
+  for (;;) {
+    sEnd = s;
+    do {
+      i4 = i3 + deltas[++s];
+    } while (labels[i4] == 0);
+    s &= 7;
+
+    // Passing east means the pixel's right neighbour is background
+    if (static_cast<unsigned>(s - 1) < static_cast<unsigned>(sEnd)) {
+      labels[i3] = -label;
+    } else if (labels[i3] == 1) {
+      labels[i3] = label;
+    }
+
+    if (s != prevS) {
+      m_points.push_back(pt);
+      prevS = s;
+    }
+    pt += kCodeDeltas[s];
+
+    if (i4 == i0 && i3 == i1) break;
+    i3 = i4;
+    s = (s + 4) & 7;
+  }
+}
+
+void PolygonApproximator::Approximate(const cv::Point* contour, int count,
+                                      double epsilon, PolygonPool& out) {
+  // approxPolyDP_ from OpenCV's approx.cpp, closed contours only
+  if (count == 0) {
+    out.EndPolygon();
+    return;
+  }
+  m_points.resize(count);
+  m_stack.clear();
+  cv::Point* dst = m_points.data();
+  int newCount = 0;
+  double eps = epsilon * epsilon;
+
+  auto read = [&](cv::Point& pt, int& pos, int n, const cv::Point* src) {
+    pt = src[pos];
+    if (++pos >= n) pos = 0;
+  };
+
+  // 1. Find approximately the two farthest points of the contour
+  cv::Range slice(0, 0);
+  cv::Range rightSlice(0, 0);
+  cv::Point startPt(-1000000, -1000000);
+  cv::Point endPt(0, 0);
+  cv::Point pt(0, 0);
+  int pos = 0;
+  bool leEps = false;
+  for (int i = 0; i < 3; ++i) {
+    double maxDist = 0;
+    pos = (pos + rightSlice.start) % count;
+    read(startPt, pos, count, contour);
+    for (int j = 1; j < count; ++j) {
+      read(pt, pos, count, contour);
+      double dx = pt.x - startPt.x;
+      double dy = pt.y - startPt.y;
+      double dist = dx * dx + dy * dy;
+      if (dist > maxDist) {
+        maxDist = dist;
+        rightSlice.start = j;
+      }
+    }
+    leEps = maxDist <= eps;
+  }
+
+  // 2. Split the contour there
+  if (!leEps) {
+    rightSlice.end = slice.start = pos % count;
+    slice.end = rightSlice.start = (rightSlice.start + slice.start) % count;
+    m_stack.push_back(rightSlice);
+    m_stack.push_back(slice);
+  } else {
+    dst[newCount++] = startPt;
+  }
+
+  // 3. Split slices at their farthest point until every one is flat enough
+  while (!m_stack.empty()) {
+    slice = m_stack.back();
+    m_stack.pop_back();
+    endPt = contour[slice.end];
+    pos = slice.start;
+    read(startPt, pos, count, contour);
+
+    if (pos != slice.end) {
+      double maxDist = 0;
+      double dx = endPt.x - startPt.x;
+      double dy = endPt.y - startPt.y;
+      while (pos != slice.end) {
+        read(pt, pos, count, contour);
+        double dist =
+            std::fabs((pt.y - startPt.y) * dx - (pt.x - startPt.x) * dy);
+        if (dist > maxDist) {
+          maxDist = dist;
+          rightSlice.start = (pos + count - 1) % count;
+        }
+      }
+      leEps = maxDist * maxDist <= eps * (dx * dx + dy * dy);
+    } else {
+      leEps = true;
+      startPt = contour[slice.start];
+    }
+
+    if (leEps) {
+      dst[newCount++] = startPt;
+    } else {
+      rightSlice.end = slice.end;
+      slice.end = rightSlice.start;
+      m_stack.push_back(rightSlice);
+      m_stack.push_back(slice);
+    }
+  }
+
+  // 4. Drop vertices on [almost] straight lines
+  count = newCount;
+  pos = count - 1;
+  read(startPt, pos, count, dst);
+  int wpos = pos;
+  read(pt, pos, count, dst);
+  for (int i = 0; i < count && newCount > 2; ++i) {
+    read(endPt, pos, count, dst);
+    double dx = endPt.x - startPt.x;
+    double dy = endPt.y - startPt.y;
+    double dist = std::fabs((pt.x - startPt.x) * dy - (pt.y - startPt.y) * dx);
+    double successiveInnerProduct = (pt.x - startPt.x) * (endPt.x - pt.x) +
+                                    (pt.y - startPt.y) * (endPt.y - pt.y);
+    if (dist * dist <= 0.5 * eps * (dx * dx + dy * dy) && dx != 0 &&
+        dy != 0 && successiveInnerProduct >= 0) {
+      --newCount;
+      dst[wpos] = startPt = endPt;
+      if (++wpos >= count) wpos = 0;
+      read(pt, pos, count, dst);
+      ++i;
+      continue;
+    }
+    dst[wpos] = startPt = pt;
+    if (++wpos >= count) wpos = 0;
+    pt = endPt;
+  }
+
+  for (int i = 0; i < newCount; ++i) out.Add(dst[i]);
+  out.EndPolygon();
+}
@@ -0,0 +1,114 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+namespace dragonvision {
+
+/**
+ * Polygons stored back to back in one point array. Clear() keeps the
+ * capacity, so once the pool has held the busiest frame, refilling it does
+ * not allocate.
+ */
+class PolygonPool {
+ public:
+  void Clear() {
+    m_points.clear();
+    m_ends.clear();
+  }
+
+  int Size() const { return static_cast<int>(m_ends.size()); }
+
+  const cv::Point* Points(int i) const { return m_points.data() + Begin(i); }
+  int Count(int i) const { return m_ends[i] - Begin(i); }
+
+  /**
+   * Polygon i as an N x 1 CV_32SC2 header into the pool, like one element
+   * of cv::findContours' output. Valid until the pool is next changed.
+   */
+  cv::Mat Polygon(int i) const {
+    return cv::Mat(Count(i), 1, CV_32SC2, const_cast<cv::Point*>(Points(i)));
+  }
+
+  void Add(cv::Point point) { m_points.push_back(point); }
+
+  /** Ends the polygon made of the points added since the last one. */
+  void EndPolygon() { m_ends.push_back(static_cast<int>(m_points.size())); }
+
+ private:
+  int Begin(int i) const { return i == 0 ? 0 : m_ends[i - 1]; }
+
+  std::vector<cv::Point> m_points;
+  std::vector<int> m_ends;
+};
+
+/**
+ * Border following (Suzuki and Abe, 1985) on 8-bit masks. Gives the same
+ * contours in the same order as cv::findContours with CHAIN_APPROX_SIMPLE,
+ * but the label image, the contour tree and the points all live in the
+ * finder between calls. After the first few frames finding contours does
+ * not allocate, where OpenCV sets up a CvMemStorage and a padded copy of the
+ * image on every call.
+ */
+class ContourFinder {
+ public:
+  enum class Mode {
+    /** Outer borders only, as cv::RETR_EXTERNAL. */
+    kExternal,
+    /** Outer and hole borders in cv::RETR_TREE order. */
+    kTree
+  };
+
+  /** Forgets the contours found so far. */
+  void Clear() { m_contours.Clear(); }
+
+  /**
+   * Appends the borders of the nonzero pixels of mask (CV_8UC1), with offset
+   * added to every point.
+   */
+  void Find(const cv::Mat& mask, Mode mode, cv::Point offset = {});
+
+  const PolygonPool& Contours() const { return m_contours; }
+
+ private:
+  struct Border {
+    int parent;  // index into m_borders, or -1 for the image frame
+    bool hole;
+    int firstChild = -1;
+    int nextSibling = -1;
+    int begin = 0;  // points in m_points
+    int end = 0;
+  };
+
+  void Follow(int start, cv::Point origin, bool hole, int label);
+
+  PolygonPool m_contours;
+  std::vector<int> m_labels;
+  std::vector<Border> m_borders;
+  std::vector<cv::Point> m_points;
+  int m_firstRoot = -1;
+  int m_step = 0;
+};
+
+/**
+ * cv::approxPolyDP for closed integer contours, with the same vertices as
+ * OpenCV. OpenCV's version takes its scratch from the heap for contours of
+ * more than about 130 points; this one keeps it between calls.
+ */
+class PolygonApproximator {
+ public:
+  /** Appends the approximation of contour to out as one polygon. */
+  void Approximate(const cv::Point* contour, int count, double epsilon,
+                   PolygonPool& out);
+
+ private:
+  std::vector<cv::Point> m_points;
+  std::vector<cv::Range> m_stack;
+};
+
+}  // namespace dragonvision
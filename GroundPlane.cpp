@@ -0,0 +1,113 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "GroundPlane.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace dragonvision;
+
+GroundPlane::GroundPlane(const CameraMount& mount, double objectHeight)
+    : m_drop(mount.height > 0.0 ? objectHeight - mount.height : 0.0),
+      m_sinPitch(std::sin(mount.pitch * CV_PI / 180.0)),
+      m_cosPitch(std::cos(mount.pitch * CV_PI / 180.0)),
+      m_sinYaw(std::sin(mount.yaw * CV_PI / 180.0)),
+      m_cosYaw(std::cos(mount.yaw * CV_PI / 180.0)) {}
+
+void GroundPlane::SetCamera(const CameraModel& camera) {
+  cv::Size size = camera.GetFrameSize();
+  if (size == m_size || size.width <= 0 || size.height <= 0) return;
+  m_size = size;
+  m_rows.clear();
+  if (m_drop == 0.0) return;
+
+  // The ideal rows the frame reaches: distortion bends its top and bottom
+  // edges, so look along both
+  std::vector<cv::Point2f> edges;
+  for (int col = 0; col < size.width + CameraModel::kAngleTableStep;
+       col += CameraModel::kAngleTableStep) {
+    float x = static_cast<float>(std::min(col, size.width - 1));
+    edges.emplace_back(x, 0.0f);
+    edges.emplace_back(x, static_cast<float>(size.height - 1));
+  }
+  std::vector<cv::Point2f> normalized(edges.size());
+  camera.Normalize(edges.data(), normalized.data(),
+                   static_cast<int>(edges.size()));
+  auto [top, bottom] = std::minmax_element(
+      normalized.begin(), normalized.end(),
+      [](cv::Point2f a, cv::Point2f b) { return a.y < b.y; });
+
+  // One entry per ideal pixel row
+  m_step = 1.0 / camera.GetCameraMatrix()(1, 1);
+  m_firstY = top->y;
+  size_t rows = static_cast<size_t>(std::ceil((bottom->y - top->y) / m_step));
+  m_rows.resize(rows + 1);
+  for (size_t i = 0; i < m_rows.size(); ++i) {
+    double depth = 0.0, forward = 0.0;
+    RowRange(m_firstY + i * m_step, depth, forward);
+    m_rows[i] = cv::Vec2f(static_cast<float>(depth),
+                          static_cast<float>(forward));
+  }
+
+  // Toward the horizon the range grows faster than a line between rows can
+  // follow; a change of 2% from one row to the next interpolates to within
+  // 0.005%, so send steeper rows to LocateExact()
+  constexpr float kMaxRowChange = 1.02f;
+  for (size_t i = 0; i + 1 < m_rows.size(); ++i) {
+    float a = m_rows[i][0], b = m_rows[i + 1][0];
+    if (b > a * kMaxRowChange || a > b * kMaxRowChange) m_rows[i][0] = 0.0f;
+  }
+}
+
+bool GroundPlane::RowRange(double y, double& depth, double& forward) const {
+  // The ray (x, y, 1) climbs sin(pitch) - y cos(pitch) per unit of depth,
+  // and has to climb m_drop
+  double climb = m_sinPitch - y * m_cosPitch;
+  double t = m_drop / climb;
+  if (m_drop == 0.0 || !(t > 0.0) || !std::isfinite(t)) return false;
+  depth = t;
+  forward = t * (m_cosPitch + y * m_sinPitch);
+  return true;
+}
+
+bool GroundPlane::Locate(cv::Point2f normalized, double& distance, double& x,
+                         double& y) const {
+  double row = (normalized.y - m_firstY) / m_step;
+  size_t i = static_cast<size_t>(row);
+  // Off the table, or next to a row that misses the plane or is too steep
+  // to interpolate
+  if (!(row >= 0.0) || i + 1 >= m_rows.size() || m_rows[i][0] == 0.0f ||
+      m_rows[i + 1][0] == 0.0f) {
+    return LocateExact(normalized, distance, x, y);
+  }
+  float t = static_cast<float>(row - i);
+  cv::Vec2f entry = m_rows[i] * (1.0f - t) + m_rows[i + 1] * t;
+  double depth = entry[0];
+  distance = depth * std::sqrt(normalized.x * normalized.x +
+                               normalized.y * normalized.y + 1.0);
+  Turn(entry[1], depth * normalized.x, x, y);
+  return true;
+}
+
+bool GroundPlane::LocateExact(cv::Point2f normalized, double& distance,
+                              double& x, double& y) const {
+  double depth, forward;
+  if (!RowRange(normalized.y, depth, forward)) return false;
+  distance = depth * std::sqrt(normalized.x * normalized.x +
+                               normalized.y * normalized.y + 1.0);
+  Turn(forward, depth * normalized.x, x, y);
+  return true;
+}
+
+void GroundPlane::Position(const cv::Vec3d& point, double& x,
+                           double& y) const {
+  Turn(point[2] * m_cosPitch + point[1] * m_sinPitch, point[0], x, y);
+}
+
+void GroundPlane::Turn(double forward, double right, double& x,
+                       double& y) const {
+  x = forward * m_cosYaw + right * m_sinYaw;
+  y = forward * m_sinYaw - right * m_cosYaw;
+}
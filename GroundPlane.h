@@ -0,0 +1,110 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "CameraModel.h"
+
+namespace dragonvision {
+
+/**
+ * How a camera sits on the robot, as read from its "ground plane" config.
+ */
+struct CameraMount {
+  /** Height of the lens above the carpet, in inches. */
+  double height = 0.0;
+
+  /** Tilt of the optical axis above the horizontal, in degrees. */
+  double pitch = 0.0;
+
+  /**
+   * Turn of the optical axis from the robot's forward, in degrees; positive
+   * to the left (counterclockwise seen from above), like the angles.
+   */
+  double yaw = 0.0;
+};
+
+/**
+ * Locates objects resting on the carpet from where their center is seen,
+ * given how the camera is mounted: the ray through the center meets the
+ * plane of object centers, objectHeight above the carpet, at one point.
+ * Unlike the apparent radius, that does not depend on how much of the
+ * object the threshold kept.
+ *
+ * Positions are on the carpet, in inches from the point below the lens: x
+ * along the robot's forward and y to its left.
+ *
+ * Along a row of an ideal (undistorted) image, every ray meets the plane at
+ * the same depth (z in the camera's frame) and the same forward range.
+ * Those two numbers are worked out for every ideal row the
+ * camera can see whenever the frame size changes, and Locate() interpolates
+ * between them, except near the horizon where the range climbs too steeply.
+ */
+class GroundPlane {
+ public:
+  /**
+   * @param mount        the camera's mount; a height of 0 leaves Locate()
+   *                     finding nothing
+   * @param objectHeight height of the objects' centers above the carpet
+   */
+  explicit GroundPlane(const CameraMount& mount = {},
+                       double objectHeight = 0.0);
+
+  /**
+   * Rebuilds the row table for camera's current frame size; does nothing if
+   * that is the size it already has.
+   */
+  void SetCamera(const CameraModel& camera);
+
+  /**
+   * Where an object whose center is seen at normalized (undistorted)
+   * coordinates is.
+   *
+   * @param distance set to the distance from the lens to the center
+   * @param x, y     set to its position on the carpet
+   * @return false, leaving the outputs alone, if the ray never meets the
+   *         plane of object centers (at or above the horizon, or no mount)
+   */
+  bool Locate(cv::Point2f normalized, double& distance, double& x,
+              double& y) const;
+
+  /** Locate() without the table. */
+  bool LocateExact(cv::Point2f normalized, double& distance, double& x,
+                   double& y) const;
+
+  /**
+   * Position on the carpet of a point in the camera's frame (x right, y
+   * down, z forward), e.g. a ray scaled to a distance.
+   */
+  void Position(const cv::Vec3d& point, double& x, double& y) const;
+
+  /** Bytes the row table takes; 0 if it is not built. */
+  size_t GetTableBytes() const { return m_rows.size() * sizeof(m_rows[0]); }
+
+ private:
+  // Depth and forward range at which the rays of normalized y meet the
+  // plane; false if they miss it
+  bool RowRange(double y, double& depth, double& forward) const;
+
+  // Turns forward and right of the optical axis into x and y
+  void Turn(double forward, double right, double& x, double& y) const;
+
+  double m_drop;  // objectHeight - height
+  double m_sinPitch, m_cosPitch;
+  double m_sinYaw, m_cosYaw;
+  cv::Size m_size;
+
+  // Depth and forward range of ideal rows m_firstY + i * m_step, in
+  // normalized y; a depth of 0 marks a row that misses the plane, or whose
+  // range changes too much by the next row to interpolate
+  std::vector<cv::Vec2f> m_rows;
+  double m_firstY = 0.0;
+  double m_step = 1.0;
+};
+
+}  // namespace dragonvision
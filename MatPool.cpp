@@ -0,0 +1,198 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "MatPool.h"
+
+#include <cstdlib>
+#include <new>
+
+using namespace dragonvision;
+
+namespace {
+
+constexpr size_t kHeaderSize =
+    (sizeof(cv::UMatData) + MatPool::kAlignment - 1) &
+    ~(MatPool::kAlignment - 1);
+
+std::atomic<bool> gInstalled{false};
+
+// Set once this thread's cache has been handed back, for Mats freed by
+// later thread_local destructors
+thread_local bool tCacheClosed = false;
+
+}  // namespace
+
+namespace dragonvision {
+
+// Free blocks this thread may reuse without taking the pool's mutex. Handed
+// back to the shared lists when the thread exits.
+struct ThreadCache {
+  MatPool::FreeBlock* heads[MatPool::kClasses] = {};
+  int counts[MatPool::kClasses] = {};
+
+  ~ThreadCache() {
+    auto& pool = MatPool::Instance();
+    for (int c = 0; c < MatPool::kClasses; ++c) {
+      while (heads[c]) {
+        auto block = heads[c];
+        heads[c] = block->next;
+        std::lock_guard<std::mutex> lock(pool.m_mutex);
+        block->next = pool.m_free[c];
+        pool.m_free[c] = block;
+      }
+    }
+    tCacheClosed = true;
+  }
+};
+
+}  // namespace dragonvision
+
+namespace {
+
+thread_local ThreadCache tCache;
+
+}  // namespace
+
+MatPool& MatPool::Instance() {
+  static MatPool* pool = new MatPool;
+  return *pool;
+}
+
+void MatPool::Install() {
+  cv::Mat::setDefaultAllocator(&Instance());
+  gInstalled = true;
+}
+
+bool MatPool::Installed() { return gInstalled; }
+
+MatPoolStats MatPool::GetStats() const {
+  MatPoolStats stats;
+  stats.liveBytes = m_liveBytes.load(std::memory_order_relaxed);
+  stats.peakBytes = m_peakBytes.load(std::memory_order_relaxed);
+  stats.idleBytes = m_idleBytes.load(std::memory_order_relaxed);
+  stats.hits = m_hits.load(std::memory_order_relaxed);
+  stats.misses = m_misses.load(std::memory_order_relaxed);
+  return stats;
+}
+
+int MatPool::ClassOf(size_t size) {
+  if (size <= 256) return 0;
+  int octave = 63 - __builtin_clzll(size - 1);                 // 8 to 23
+  int sub = static_cast<int>((size - 1) >> (octave - 2)) - 4;  // 0 to 3
+  return 1 + (octave - 8) * 4 + sub;
+}
+
+size_t MatPool::ClassSize(int sizeClass) {
+  if (sizeClass == 0) return 256;
+  int octave = (sizeClass - 1) / 4 + 8;
+  size_t sub = (sizeClass - 1) % 4;
+  return (5 + sub) << (octave - 2);
+}
+
+void* MatPool::Take(int sizeClass) const {
+  FreeBlock* block = nullptr;
+  if (!tCacheClosed) {
+    auto& cache = tCache;
+    block = cache.heads[sizeClass];
+    if (block) {
+      cache.heads[sizeClass] = block->next;
+      --cache.counts[sizeClass];
+    }
+  }
+  if (!block) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    block = m_free[sizeClass];
+    if (block) m_free[sizeClass] = block->next;
+  }
+  if (!block) return nullptr;
+  m_idleBytes.fetch_sub(ClassSize(sizeClass), std::memory_order_relaxed);
+  return block;
+}
+
+void MatPool::Give(void* ptr, int sizeClass) const {
+  auto block = static_cast<FreeBlock*>(ptr);
+  m_idleBytes.fetch_add(ClassSize(sizeClass), std::memory_order_relaxed);
+  if (!tCacheClosed) {
+    auto& cache = tCache;
+    if (cache.counts[sizeClass] < kThreadCacheDepth) {
+      block->next = cache.heads[sizeClass];
+      cache.heads[sizeClass] = block;
+      ++cache.counts[sizeClass];
+      return;
+    }
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  block->next = m_free[sizeClass];
+  m_free[sizeClass] = block;
+}
+
+cv::UMatData* MatPool::allocate(int dims, const int* sizes, int type,
+                                void* data, size_t* step, int flags,
+                                cv::UMatUsageFlags usageFlags) const {
+  // Headers over caller memory have nothing to pool
+  if (data) {
+    return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step,
+                                                flags, usageFlags);
+  }
+
+  // Dense layout, as OpenCV's own allocator does it
+  size_t total = CV_ELEM_SIZE(type);
+  for (int i = dims - 1; i >= 0; --i) {
+    if (step) step[i] = total;
+    total *= sizes[i];
+  }
+
+  size_t blockSize = kHeaderSize + total;
+  int sizeClass = kClasses;  // not pooled
+  void* block = nullptr;
+  if (blockSize <= kMaxPooledSize) {
+    sizeClass = ClassOf(blockSize);
+    blockSize = ClassSize(sizeClass);
+    block = Take(sizeClass);
+  }
+  if (block) {
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    if (posix_memalign(&block, kAlignment, blockSize) != 0) {
+      CV_Error_(cv::Error::StsNoMem,
+                ("Failed to allocate %llu bytes",
+                 static_cast<unsigned long long>(blockSize)));
+    }
+    m_misses.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint64_t live =
+      m_liveBytes.fetch_add(blockSize, std::memory_order_relaxed) + blockSize;
+  uint64_t peak = m_peakBytes.load(std::memory_order_relaxed);
+  while (live > peak && !m_peakBytes.compare_exchange_weak(
+                            peak, live, std::memory_order_relaxed)) {
+  }
+
+  auto u = new (block) cv::UMatData(this);
+  u->data = u->origdata = static_cast<uchar*>(block) + kHeaderSize;
+  u->size = total;
+  u->allocatorFlags_ = sizeClass;
+  return u;
+}
+
+bool MatPool::allocate(cv::UMatData* u, int, cv::UMatUsageFlags) const {
+  return u != nullptr;
+}
+
+void MatPool::deallocate(cv::UMatData* u) const {
+  if (!u) return;
+  CV_Assert(u->urefcount == 0);
+  CV_Assert(u->refcount == 0);
+
+  int sizeClass = u->allocatorFlags_;
+  size_t blockSize = sizeClass < kClasses ? ClassSize(sizeClass)
+                                          : kHeaderSize + u->size;
+  u->~UMatData();
+  m_liveBytes.fetch_sub(blockSize, std::memory_order_relaxed);
+  if (sizeClass < kClasses) {
+    Give(u, sizeClass);
+  } else {
+    std::free(u);
+  }
+}
@@ -0,0 +1,102 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include <opencv2/core.hpp>
+
+namespace dragonvision {
+
+/** Counters of a MatPool, as returned by MatPool::GetStats(). */
+struct MatPoolStats {
+  /** Bytes held by live Mats, rounded up to their size class. */
+  uint64_t liveBytes = 0;
+  /** Most liveBytes has ever been. */
+  uint64_t peakBytes = 0;
+  /** Bytes in free blocks, kept for reuse. */
+  uint64_t idleBytes = 0;
+  /** Allocations served from a free list. */
+  uint64_t hits = 0;
+  /** Allocations that went to the system. */
+  uint64_t misses = 0;
+};
+
+/**
+ * cv::MatAllocator that keeps freed buffers for reuse instead of returning
+ * them to malloc. Requests are rounded up to size classes four to an
+ * octave, so a buffer freed at one resolution can serve the next frame's
+ * slightly different size, and a resolution change reuses what the old one
+ * left behind instead of fragmenting the heap.
+ *
+ * Each block holds the UMatData header followed by the pixels, both
+ * kAlignment aligned, so a pool hit does not touch the heap at all. Freed
+ * blocks go to a small per-thread cache first and to a shared list behind
+ * a mutex after that. Blocks above kMaxPooledSize go straight to the
+ * system and back.
+ *
+ * The pool is process-wide and never destroyed, since Mats may outlive
+ * main().
+ */
+class MatPool : public cv::MatAllocator {
+ public:
+  /** Cache line, and more than NEON needs. */
+  static constexpr size_t kAlignment = 64;
+  static constexpr size_t kMaxPooledSize = size_t{1} << 24;
+  /** Free blocks of each size class a thread keeps for itself. */
+  static constexpr int kThreadCacheDepth = 4;
+
+  static MatPool& Instance();
+
+  /**
+   * Makes the pool OpenCV's default allocator, for every Mat created from
+   * now on, including those inside cscore and OpenCV itself.
+   */
+  static void Install();
+
+  /** True once Install() has been called. */
+  static bool Installed();
+
+  MatPoolStats GetStats() const;
+
+  cv::UMatData* allocate(int dims, const int* sizes, int type, void* data,
+                         size_t* step, int flags,
+                         cv::UMatUsageFlags usageFlags) const override;
+  bool allocate(cv::UMatData* data, int accessFlags,
+                cv::UMatUsageFlags usageFlags) const override;
+  void deallocate(cv::UMatData* data) const override;
+
+ private:
+  friend struct ThreadCache;
+
+  // Four classes per octave from 256 bytes to kMaxPooledSize
+  static constexpr int kClasses = 1 + 16 * 4;
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  MatPool() = default;
+
+  static int ClassOf(size_t size);
+  static size_t ClassSize(int sizeClass);
+
+  void* Take(int sizeClass) const;
+  void Give(void* block, int sizeClass) const;
+
+  mutable std::mutex m_mutex;
+  mutable FreeBlock* m_free[kClasses] = {};
+
+  mutable std::atomic<uint64_t> m_liveBytes{0};
+  mutable std::atomic<uint64_t> m_peakBytes{0};
+  mutable std::atomic<uint64_t> m_idleBytes{0};
+  mutable std::atomic<uint64_t> m_hits{0};
+  mutable std::atomic<uint64_t> m_misses{0};
+};
+
+}  // namespace dragonvision
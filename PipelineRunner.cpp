@@ -0,0 +1,236 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "PipelineRunner.h"
+
+#include <algorithm>
+#include <optional>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <wpi/raw_ostream.h>
+#include <wpi/timestamp.h>
+
+using namespace dragonvision;
+
+PipelineRunnerBase::PipelineRunnerBase(cs::VideoSource videoSource,
+                                       CaptureMode mode, FrameFormat format,
+                                       int bufferCount)
+    : m_mode(mode), m_format(format) {
+  if (m_format == FrameFormat::kBGR) {
+    m_cvSink = cs::CvSink("PipelineRunner " + videoSource.GetName());
+    m_cvSink.SetSource(videoSource);
+  } else {
+    m_rawSink = cs::RawSink("PipelineRunner " + videoSource.GetName());
+    m_rawSink.SetSource(videoSource);
+  }
+
+  if (m_mode == CaptureMode::kSynchronous)
+    bufferCount = 1;
+  else
+    bufferCount = std::max(bufferCount, kDefaultBufferCount);
+
+  // Size the BGR buffers for the current video mode up front so frames can be
+  // decoded straight into them without reallocating.
+  m_buffers.resize(bufferCount);
+  m_frames.resize(bufferCount);
+  if (m_format == FrameFormat::kNative) {
+    m_rawFrames = std::make_unique<cs::RawFrame[]>(bufferCount);
+    m_decoded.resize(bufferCount);
+  }
+  auto& bgrBuffers = m_format == FrameFormat::kBGR ? m_buffers : m_decoded;
+  auto videoMode = videoSource.GetVideoMode();
+  if (videoMode.width > 0 && videoMode.height > 0) {
+    for (auto& buffer : bgrBuffers)
+      buffer.create(videoMode.height, videoMode.width, CV_8UC3);
+  }
+}
+
+PipelineRunnerBase::~PipelineRunnerBase() {
+  Stop();
+  if (m_grabThread.joinable()) m_grabThread.join();
+}
+
+void PipelineRunnerBase::RunOnce() {
+  Throttle();
+  std::optional<ProcessingScheduler::Slot> cpu;
+
+  if (m_mode == CaptureMode::kSynchronous) {
+    auto frameTime = Grab(0);
+    if (!ReportGrabResult(frameTime)) return;
+    m_frames[0].captureTime = frameTime;
+    m_frames[0].grabTime = wpi::Now();
+    m_frames[0].sequence = ++m_captured;
+    if (m_scheduler) cpu.emplace(m_scheduler->Acquire());
+    DoProcess(m_buffers[0], m_frames[0]);
+    cpu.reset();
+    ++m_processed;
+    PublishStats();
+    return;
+  }
+
+  if (!m_grabThread.joinable() && m_enabled)
+    m_grabThread = std::thread([this] { GrabLoop(); });
+
+  // Only ask for a turn once there is a frame, so a runner waiting on its
+  // camera never holds a slot the others could use. Pick the frame after the
+  // turn comes, so it is the newest one when processing actually starts.
+  {
+    std::unique_lock lock(m_mutex);
+    m_frameReady.wait(lock, [&] { return m_latestSlot >= 0 || !m_enabled; });
+    if (m_latestSlot < 0) return;
+  }
+  if (m_scheduler) cpu.emplace(m_scheduler->Acquire());
+
+  int slot;
+  {
+    std::scoped_lock lock(m_mutex);
+    slot = m_latestSlot;
+    m_processingSlot = slot;
+    m_latestSlot = -1;
+  }
+
+  DoProcess(m_buffers[slot], m_frames[slot]);
+  cpu.reset();
+
+  {
+    std::scoped_lock lock(m_mutex);
+    m_processingSlot = -1;
+  }
+  ++m_processed;
+  PublishStats();
+}
+
+void PipelineRunnerBase::RunForever() {
+  while (m_enabled) {
+    RunOnce();
+  }
+}
+
+void PipelineRunnerBase::Stop() {
+  m_enabled = false;
+  m_frameReady.notify_all();
+}
+
+void PipelineRunnerBase::SetStatsTable(
+    std::shared_ptr<nt::NetworkTable> table) {
+  m_capturedEntry = table->GetEntry("FramesCaptured");
+  m_processedEntry = table->GetEntry("FramesProcessed");
+  m_droppedEntry = table->GetEntry("FramesDropped");
+}
+
+void PipelineRunnerBase::SetScheduler(
+    std::shared_ptr<ProcessingScheduler> scheduler) {
+  m_scheduler = std::move(scheduler);
+}
+
+void PipelineRunnerBase::SetMaxFps(double fps) {
+  m_minPeriod = fps > 0.0 ? std::chrono::duration_cast<
+                                std::chrono::steady_clock::duration>(
+                                std::chrono::duration<double>(1.0 / fps))
+                          : std::chrono::steady_clock::duration::zero();
+}
+
+void PipelineRunnerBase::Throttle() {
+  if (m_minPeriod.count() > 0)
+    std::this_thread::sleep_until(m_lastRun + m_minPeriod);
+  m_lastRun = std::chrono::steady_clock::now();
+}
+
+void PipelineRunnerBase::GrabLoop() {
+  while (m_enabled) {
+    // pick a slot that is neither queued nor being processed
+    int slot = 0;
+    {
+      std::scoped_lock lock(m_mutex);
+      while (slot == m_latestSlot || slot == m_processingSlot) ++slot;
+    }
+
+    auto frameTime = Grab(slot);
+    auto grabTime = wpi::Now();
+    if (!ReportGrabResult(frameTime)) continue;
+
+    {
+      std::scoped_lock lock(m_mutex);
+      m_frames[slot].captureTime = frameTime;
+      m_frames[slot].grabTime = grabTime;
+      m_frames[slot].sequence = ++m_captured;
+      // latest frame wins: an unprocessed frame still waiting is discarded
+      if (m_latestSlot >= 0) ++m_dropped;
+      m_latestSlot = slot;
+    }
+    m_frameReady.notify_one();
+  }
+}
+
+uint64_t PipelineRunnerBase::Grab(int slot) {
+  if (m_format == FrameFormat::kBGR) {
+    m_frames[slot].pixelFormat = cs::VideoMode::kBGR;
+    return m_cvSink.GrabFrame(m_buffers[slot]);
+  }
+
+  // Ask for whatever the camera delivers rather than the previous frame's
+  // format, so a video mode change is picked up.
+  auto& raw = m_rawFrames[slot];
+  raw.pixelFormat = CS_PIXFMT_UNKNOWN;
+  // RawSink::GrabFrame() is protected, so go through the handle API
+  CS_Status status = 0;
+  auto frameTime =
+      cs::GrabSinkFrameTimeout(m_rawSink.GetHandle(), raw, 0.225, &status);
+  if (frameTime == 0) return 0;
+
+  auto& image = m_buffers[slot];
+  auto& decoded = m_decoded[slot];
+  switch (raw.pixelFormat) {
+    case cs::VideoMode::kYUYV:
+      image = cv::Mat(raw.height, raw.width, CV_8UC2, raw.data);
+      m_frames[slot].pixelFormat = cs::VideoMode::kYUYV;
+      return frameTime;
+    case cs::VideoMode::kMJPEG:
+      // OpenCV can only decode JPEG to BGR, so this costs the same as CvSink
+      cv::imdecode(cv::Mat(1, raw.dataLength, CV_8U, raw.data),
+                   cv::IMREAD_COLOR, &decoded);
+      break;
+    case cs::VideoMode::kBGR:
+      cv::Mat(raw.height, raw.width, CV_8UC3, raw.data).copyTo(decoded);
+      break;
+    case cs::VideoMode::kRGB565:
+      cv::cvtColor(cv::Mat(raw.height, raw.width, CV_8UC2, raw.data), decoded,
+                   cv::COLOR_BGR5652BGR);
+      break;
+    case cs::VideoMode::kGray:
+      cv::cvtColor(cv::Mat(raw.height, raw.width, CV_8U, raw.data), decoded,
+                   cv::COLOR_GRAY2BGR);
+      break;
+    default:
+      return 0;
+  }
+  image = decoded;
+  m_frames[slot].pixelFormat = cs::VideoMode::kBGR;
+  return decoded.empty() ? 0 : frameTime;
+}
+
+bool PipelineRunnerBase::ReportGrabResult(uint64_t frameTime) {
+  if (frameTime == 0) {
+    // only report the start of an outage, not every timeout during it
+    if (!m_grabFailing) {
+      wpi::errs() << "PipelineRunner: "
+                  << (m_format == FrameFormat::kBGR ? m_cvSink.GetError()
+                                                    : m_rawSink.GetError())
+                  << '\n';
+    }
+    m_grabFailing = true;
+    return false;
+  }
+  m_grabFailing = false;
+  return true;
+}
+
+void PipelineRunnerBase::PublishStats() {
+  if (!m_capturedEntry) return;
+  m_capturedEntry.SetDouble(m_captured);
+  m_processedEntry.SetDouble(m_processed);
+  m_droppedEntry.SetDouble(m_dropped);
+}
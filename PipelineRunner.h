@@ -0,0 +1,206 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/mat.hpp>
+
+#include <networktables/NetworkTable.h>
+#include <networktables/NetworkTableEntry.h>
+
+#include "cscore.h"
+#include "cscore_cv.h"
+#include "cscore_raw.h"
+#include "ProcessingScheduler.h"
+#include "TimedVisionPipeline.h"
+
+namespace dragonvision {
+
+/**
+ * Non-template base class for PipelineRunner.
+ *
+ * This plays the same role as frc::VisionRunnerBase, but can optionally move
+ * frame capture onto a dedicated grabber thread so that the camera keeps
+ * being drained while the pipeline is busy.
+ */
+class PipelineRunnerBase {
+ public:
+  enum class CaptureMode {
+    /** Grab and process on the calling thread, like frc::VisionRunner. */
+    kSynchronous,
+    /**
+     * Grab on a dedicated thread into a small ring of preallocated buffers.
+     * The processing thread always takes the newest frame; frames that were
+     * captured but never processed are counted as dropped.
+     */
+    kLatestFrame
+  };
+
+  enum class FrameFormat {
+    /** Frames are converted to BGR by cscore, like frc::VisionRunner. */
+    kBGR,
+    /**
+     * Frames are grabbed with a cs::RawSink in the camera's own format. YUYV
+     * frames are handed over untouched as CV_8UC2 images (see
+     * FrameInfo::pixelFormat); anything else is converted to BGR here.
+     */
+    kNative
+  };
+
+  /** Number of ring buffers used in kLatestFrame mode. */
+  static constexpr int kDefaultBufferCount = 3;
+
+  /**
+   * Creates a new pipeline runner. It will take images from the {@code
+   * videoSource}, and call the virtual DoProcess() method.
+   *
+   * @param videoSource the video source to use to supply images for the
+   *                    pipeline
+   * @param mode        how frames are captured
+   * @param format      what image layout the pipeline is given
+   * @param bufferCount number of preallocated frame buffers (kLatestFrame
+   *                    only, minimum 3)
+   */
+  PipelineRunnerBase(cs::VideoSource videoSource, CaptureMode mode,
+                     FrameFormat format = FrameFormat::kBGR,
+                     int bufferCount = kDefaultBufferCount);
+
+  /**
+   * Stops and joins the grabber thread. Virtual, so a runner can be deleted
+   * through a base pointer.
+   */
+  virtual ~PipelineRunnerBase();
+
+  PipelineRunnerBase(const PipelineRunnerBase&) = delete;
+  PipelineRunnerBase& operator=(const PipelineRunnerBase&) = delete;
+
+  /**
+   * Runs the pipeline one time on the newest available frame. In
+   * kSynchronous mode this blocks until the source supplies a frame; in
+   * kLatestFrame mode it starts the grabber thread on first use and blocks
+   * until a frame newer than the last processed one is available.
+   *
+   * This must be run in a dedicated thread.
+   */
+  void RunOnce();
+
+  /**
+   * A convenience method that calls RunOnce() in an infinite loop.
+   *
+   * <strong>Do not call this method directly from the main thread.</strong>
+   */
+  void RunForever();
+
+  /**
+   * Stop a RunForever() loop and the grabber thread.
+   */
+  void Stop();
+
+  /**
+   * Publish frame counters to the given table after every processed frame.
+   * Entries are resolved once here, not per frame.
+   */
+  void SetStatsTable(std::shared_ptr<nt::NetworkTable> table);
+
+  /**
+   * Share processing slots with other runners. Set before RunForever().
+   */
+  void SetScheduler(std::shared_ptr<ProcessingScheduler> scheduler);
+
+  /**
+   * Process at most this many frames per second; 0 means no limit. Frames
+   * in between are still captured, and dropped in kLatestFrame mode.
+   */
+  void SetMaxFps(double fps);
+
+  uint64_t GetFramesCaptured() const { return m_captured; }
+  uint64_t GetFramesProcessed() const { return m_processed; }
+  uint64_t GetFramesDropped() const { return m_dropped; }
+
+ protected:
+  virtual void DoProcess(cv::Mat& image, const FrameInfo& frame) = 0;
+
+ private:
+  void GrabLoop();
+  void Throttle();
+  uint64_t Grab(int slot);
+  bool ReportGrabResult(uint64_t frameTime);
+  void PublishStats();
+
+  cs::CvSink m_cvSink;
+  cs::RawSink m_rawSink;
+  CaptureMode m_mode;
+  FrameFormat m_format;
+  std::atomic_bool m_enabled{true};
+
+  // Ring buffers; in kSynchronous mode only m_buffers[0] is used.
+  std::vector<cv::Mat> m_buffers;
+  std::vector<FrameInfo> m_frames;
+
+  // kNative only: raw frame storage per slot, and BGR images for slots whose
+  // frame had to be decoded (MJPEG) or converted.
+  std::unique_ptr<cs::RawFrame[]> m_rawFrames;
+  std::vector<cv::Mat> m_decoded;
+
+  // Slot bookkeeping for kLatestFrame mode, protected by m_mutex.  A slot is
+  // either being written by the grabber, waiting as the newest frame, or being
+  // processed; with three or more slots the grabber never has to wait.
+  std::mutex m_mutex;
+  std::condition_variable m_frameReady;
+  int m_latestSlot = -1;
+  int m_processingSlot = -1;
+  std::thread m_grabThread;
+
+  std::shared_ptr<ProcessingScheduler> m_scheduler;
+  std::chrono::steady_clock::duration m_minPeriod{0};
+  std::chrono::steady_clock::time_point m_lastRun;
+
+  std::atomic<uint64_t> m_captured{0};
+  std::atomic<uint64_t> m_processed{0};
+  std::atomic<uint64_t> m_dropped{0};
+  bool m_grabFailing = false;
+
+  nt::NetworkTableEntry m_capturedEntry;
+  nt::NetworkTableEntry m_processedEntry;
+  nt::NetworkTableEntry m_droppedEntry;
+};
+
+/**
+ * A pipeline runner is a drop-in replacement for frc::VisionRunner that adds
+ * the kLatestFrame capture mode. Pipelines derived from TimedVisionPipeline
+ * are given the capture time and sequence number of each frame.
+ *
+ * @see PipelineRunnerBase
+ */
+template <typename T>
+class PipelineRunner : public PipelineRunnerBase {
+ public:
+  PipelineRunner(cs::VideoSource videoSource, T* pipeline,
+                 std::function<void(T&)> listener,
+                 CaptureMode mode = CaptureMode::kLatestFrame,
+                 FrameFormat format = FrameFormat::kBGR);
+  ~PipelineRunner() override = default;
+
+ protected:
+  void DoProcess(cv::Mat& image, const FrameInfo& frame) override;
+
+ private:
+  std::unique_ptr<T> m_pipeline;
+  std::function<void(T&)> m_listener;
+};
+
+}  // namespace dragonvision
+
+#include "PipelineRunner.inc"
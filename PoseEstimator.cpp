@@ -0,0 +1,62 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "PoseEstimator.h"
+
+#include <chrono>
+#include <cmath>
+
+#include <opencv2/calib3d.hpp>
+
+using namespace dragonvision;
+
+PoseEstimator::PoseEstimator(std::vector<cv::Point3f> model)
+    : m_model(std::move(model)), m_reprojected(m_model.size()) {}
+
+std::vector<cv::Point3f> PoseEstimator::CellModel(double radius) {
+  float r = static_cast<float>(radius);
+  return {{-r, 0.0f, 0.0f}, {r, 0.0f, 0.0f}, {0.0f, -r, 0.0f}, {0.0f, r, 0.0f}};
+}
+
+bool PoseEstimator::Solve(const CameraModel& camera,
+                          const cv::Point2f* imagePoints, TargetPose& pose,
+                          double budgetUs, double maxError) {
+  ++m_solves;
+  auto start = std::chrono::steady_clock::now();
+
+  cv::Mat image(GetPointCount(), 1, CV_32FC2,
+                const_cast<cv::Point2f*>(imagePoints));
+  cv::Vec3d rotation = pose.rotation;
+  cv::Vec3d translation = pose.translation;
+  bool solved = cv::solvePnP(m_model, image, camera.GetCameraMatrix(),
+                             camera.GetDistortion(), rotation, translation,
+                             true, cv::SOLVEPNP_ITERATIVE);
+
+  double error = HUGE_VAL;
+  if (solved && translation[2] > 0.0) {
+    cv::projectPoints(m_model, rotation, translation, camera.GetCameraMatrix(),
+                      camera.GetDistortion(), m_reprojected);
+    double sum = 0.0;
+    for (int i = 0; i < GetPointCount(); ++i) {
+      cv::Point2f d = m_reprojected[i] - imagePoints[i];
+      sum += d.dot(d);
+    }
+    error = std::sqrt(sum / GetPointCount());
+  }
+
+  double us = std::chrono::duration<double, std::micro>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  if (us > budgetUs) {
+    ++m_overBudget;
+    return false;
+  }
+  if (!(error <= maxError)) {
+    ++m_failures;
+    return false;
+  }
+  pose.rotation = rotation;
+  pose.translation = translation;
+  return true;
+}
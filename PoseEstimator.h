@@ -0,0 +1,82 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "CameraModel.h"
+
+namespace dragonvision {
+
+/**
+ * Where a target is relative to the camera, in OpenCV's camera axes (x
+ * right, y down, z forward): the translation of the target's origin in the
+ * model's units, and its rotation as a Rodrigues vector.
+ */
+struct TargetPose {
+  cv::Vec3d rotation;
+  cv::Vec3d translation;
+};
+
+/**
+ * Fits a target of known geometry to the image points it was seen at with
+ * cv::solvePnP, starting from a guess: the last frame's pose of the same
+ * target, or the radius estimate. Levenberg-Marquardt from a close guess
+ * needs only a few iterations.
+ *
+ * A fit counts only if it puts the target in front of the camera, lands
+ * every model point within maxError pixels of its image point (RMS), and
+ * took no longer than the budget. solvePnP cannot be stopped part way, so
+ * the budget is checked when it returns; the caller keeps its own estimate
+ * when a fit does not count.
+ */
+class PoseEstimator {
+ public:
+  /**
+   * @param model points of the target in its own frame; Solve() takes the
+   *              image points in the same order
+   */
+  explicit PoseEstimator(std::vector<cv::Point3f> model);
+
+  /**
+   * A cell seen as the disc its outline makes, facing the camera: the left,
+   * right, top and bottom points of a circle of radius, centered on the
+   * origin.
+   */
+  static std::vector<cv::Point3f> CellModel(double radius);
+
+  /**
+   * Number of points Solve() takes.
+   */
+  int GetPointCount() const { return static_cast<int>(m_model.size()); }
+
+  /**
+   * Fits the model to imagePoints, pixels of camera's current frame size.
+   *
+   * @param pose     the guess; replaced by the fit if it counts
+   * @param budgetUs longest a fit may take, in microseconds
+   * @param maxError largest RMS reprojection error, in pixels
+   * @return true if the fit counts
+   */
+  bool Solve(const CameraModel& camera, const cv::Point2f* imagePoints,
+             TargetPose& pose, double budgetUs, double maxError);
+
+  /** Fits tried, and those that failed or ran over the budget. */
+  uint64_t GetSolves() const { return m_solves; }
+  uint64_t GetFailures() const { return m_failures; }
+  uint64_t GetOverBudget() const { return m_overBudget; }
+
+ private:
+  std::vector<cv::Point3f> m_model;
+  std::vector<cv::Point2f> m_reprojected;
+  uint64_t m_solves = 0;
+  uint64_t m_failures = 0;
+  uint64_t m_overBudget = 0;
+};
+
+}  // namespace dragonvision
@@ -0,0 +1,34 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "ProcessingScheduler.h"
+
+#include <algorithm>
+
+using namespace dragonvision;
+
+ProcessingScheduler::ProcessingScheduler(int slots)
+    : m_slots(std::max(1, slots)), m_free(m_slots) {}
+
+ProcessingScheduler::Slot ProcessingScheduler::Acquire() {
+  std::unique_lock lock(m_mutex);
+  uint64_t ticket = m_nextTicket++;
+  m_waiting.push_back(ticket);
+  m_cond.wait(lock,
+              [&] { return m_free > 0 && m_waiting.front() == ticket; });
+  m_waiting.pop_front();
+  --m_free;
+  lock.unlock();
+  // the next waiter may be able to go too
+  m_cond.notify_all();
+  return Slot(this);
+}
+
+void ProcessingScheduler::Release() {
+  {
+    std::scoped_lock lock(m_mutex);
+    ++m_free;
+  }
+  m_cond.notify_all();
+}
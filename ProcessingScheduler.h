@@ -0,0 +1,69 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+namespace dragonvision {
+
+/**
+ * Limits how many pipelines process a frame at the same time, so several
+ * cameras together never ask for more than the Pi's cores.
+ *
+ * Waiting runners are served strictly in arrival order: a runner that just
+ * finished a frame queues behind everyone already waiting, so a slow or
+ * high-rate camera cannot keep the others from getting a turn.
+ */
+class ProcessingScheduler {
+ public:
+  /**
+   * @param slots number of pipelines allowed to run at once
+   */
+  explicit ProcessingScheduler(int slots);
+
+  ProcessingScheduler(const ProcessingScheduler&) = delete;
+  ProcessingScheduler& operator=(const ProcessingScheduler&) = delete;
+
+  /**
+   * A granted processing slot; released when destroyed.
+   */
+  class Slot {
+   public:
+    explicit Slot(ProcessingScheduler* scheduler) : m_scheduler(scheduler) {}
+    Slot(Slot&& other) : m_scheduler(other.m_scheduler) {
+      other.m_scheduler = nullptr;
+    }
+    Slot(const Slot&) = delete;
+    Slot& operator=(const Slot&) = delete;
+    ~Slot() {
+      if (m_scheduler) m_scheduler->Release();
+    }
+
+   private:
+    ProcessingScheduler* m_scheduler;
+  };
+
+  /**
+   * Blocks until it is this caller's turn and a slot is free.
+   */
+  Slot Acquire();
+
+  int GetSlots() const { return m_slots; }
+
+ private:
+  void Release();
+
+  const int m_slots;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  int m_free;
+  uint64_t m_nextTicket = 0;
+  std::deque<uint64_t> m_waiting;
+};
+
+}  // namespace dragonvision
@@ -0,0 +1,162 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "ResultPublisher.h"
+
+#include <utility>
+
+#include <networktables/NetworkTableInstance.h>
+#include <wpi/timestamp.h>
+
+using namespace dragonvision;
+
+ResultPublisher::ResultPublisher(std::shared_ptr<nt::NetworkTable> table)
+    : m_table(std::move(table)) {
+  m_record = m_table->GetEntry("NearestCell");
+  m_cells = m_table->GetEntry("Cells");
+  m_poses = m_table->GetEntry("CellPoses");
+  m_largestRadius = m_table->GetEntry("largestRadius");
+  m_largestCenterX = m_table->GetEntry("largestCenter X");
+  m_largestCenterY = m_table->GetEntry("largestCenter Y");
+  m_contourID = m_table->GetEntry("contourID");
+  m_horizontalAngle = m_table->GetEntry("NearestCellHorizontalAngle");
+  m_verticalAngle = m_table->GetEntry("NearestCellVerticalAngle");
+  m_distance = m_table->GetEntry("NearestCellDistance");
+  m_x = m_table->GetEntry("NearestCellX");
+  m_y = m_table->GetEntry("NearestCellY");
+  m_captureTimestamp = m_table->GetEntry("CaptureTimestamp");
+  m_frameSequence = m_table->GetEntry("FrameSequence");
+  m_pipelineLatency = m_table->GetEntry("PipelineLatency");
+  m_skippedEntry = m_table->GetEntry("ResultsSkipped");
+  m_thread = std::thread([this] { Run(); });
+}
+
+ResultPublisher::~ResultPublisher() { Stop(); }
+
+void ResultPublisher::Stop() {
+  {
+    std::scoped_lock lock(m_mutex);
+    m_stop = true;
+  }
+  m_resultReady.notify_one();
+  if (m_thread.joinable()) m_thread.join();
+}
+
+void ResultPublisher::Publish(const CellResult& result) {
+  {
+    std::scoped_lock lock(m_mutex);
+    // Both target buffers grow to the most targets a frame has had, and are
+    // only copied into after that
+    m_pendingTargets.assign(result.targets.begin(), result.targets.end());
+    m_pending = result;
+    m_pending.targets = m_pendingTargets;
+    if (m_hasPending) ++m_skipped;
+    m_hasPending = true;
+  }
+  m_resultReady.notify_one();
+}
+
+bool ResultPublisher::TakeTiming(Timing& timing) {
+  std::scoped_lock lock(m_mutex);
+  if (!m_hasTiming) return false;
+  timing = m_timing;
+  m_hasTiming = false;
+  return true;
+}
+
+void ResultPublisher::Run() {
+  for (;;) {
+    {
+      std::unique_lock lock(m_mutex);
+      m_resultReady.wait(lock, [this] { return m_hasPending || m_stop; });
+      if (m_stop) return;
+      // Swapping the vectors keeps m_writing.targets pointing at its data
+      std::swap(m_writing, m_pending);
+      std::swap(m_writingTargets, m_pendingTargets);
+      m_hasPending = false;
+    }
+    Timing timing;
+    timing.sequence = m_writing.sequence;
+    timing.captureTime = m_writing.captureTime;
+    timing.writeStart = wpi::Now();
+    Write(m_writing);
+    m_skippedEntry.SetDouble(m_skipped);
+    timing.written = wpi::Now();
+    // Send now instead of at the next periodic update, so the robot gets the
+    // whole frame at once and as early as possible
+    m_table->GetInstance().Flush();
+    timing.flushed = wpi::Now();
+    {
+      std::scoped_lock lock(m_mutex);
+      m_timing = timing;
+      m_hasTiming = true;
+    }
+    if (m_afterFlush) m_afterFlush();
+  }
+}
+
+void ResultPublisher::Write(const CellResult& result) {
+  // The separate keys, as before: the largest cell only while there is one,
+  // the nearest cell's angles and distance always
+  if (result.found) {
+    m_largestRadius.SetDouble(result.radius);
+    m_largestCenterX.SetDouble(result.center.x);
+    m_largestCenterY.SetDouble(result.center.y);
+    m_contourID.SetDouble(result.contourID);
+  }
+  m_horizontalAngle.SetDouble(result.horizontalAngle);
+  m_verticalAngle.SetDouble(result.verticalAngle);
+  m_distance.SetDouble(result.distance);
+  m_x.SetDouble(result.x);
+  m_y.SetDouble(result.y);
+  m_captureTimestamp.SetDouble(result.captureTime);
+  m_frameSequence.SetDouble(result.sequence);
+  m_pipelineLatency.SetDouble(result.latencyMs);
+
+  m_values[kSequence] = result.sequence;
+  m_values[kCaptureTimestamp] = result.captureTime;
+  m_values[kLatency] = result.latencyMs;
+  m_values[kFound] = result.found ? 1.0 : 0.0;
+  m_values[kHorizontalAngle] = result.horizontalAngle;
+  m_values[kVerticalAngle] = result.verticalAngle;
+  m_values[kDistance] = result.distance;
+  m_values[kRadius] = result.radius;
+  m_values[kCenterX] = result.center.x;
+  m_values[kCenterY] = result.center.y;
+  m_values[kX] = result.x;
+  m_values[kY] = result.y;
+  m_record.SetDoubleArray(m_values);
+
+  // Parallel arrays, packed back to back
+  size_t n = result.targets.size();
+  m_cellValues.resize(kCellsHeader + kCellsColumns * n);
+  m_cellValues[0] = result.sequence;
+  m_cellValues[1] = n;
+  double* columns = m_cellValues.data() + kCellsHeader;
+  for (size_t i = 0; i < n; ++i) {
+    const auto& target = result.targets[i];
+    columns[i] = target.horizontalAngle;
+    columns[n + i] = target.distance;
+    columns[2 * n + i] = target.radius;
+    columns[3 * n + i] = target.confidence;
+    columns[4 * n + i] = target.x;
+    columns[5 * n + i] = target.y;
+  }
+  m_cells.SetDoubleArray(m_cellValues);
+
+  if (!result.poses) return;
+  m_poseValues.resize(kCellsHeader + kPoseColumns * n);
+  m_poseValues[0] = result.sequence;
+  m_poseValues[1] = n;
+  columns = m_poseValues.data() + kCellsHeader;
+  for (size_t i = 0; i < n; ++i) {
+    const auto& target = result.targets[i];
+    for (int axis = 0; axis < 3; ++axis) {
+      columns[axis * n + i] = target.translation[axis];
+      columns[(3 + axis) * n + i] = target.rotation[axis];
+    }
+    columns[6 * n + i] = target.poseValid ? 1.0 : 0.0;
+  }
+  m_poses.SetDoubleArray(m_poseValues);
+}
@@ -0,0 +1,230 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core/matx.hpp>
+#include <opencv2/core/types.hpp>
+
+#include <networktables/NetworkTable.h>
+#include <networktables/NetworkTableEntry.h>
+#include <wpi/ArrayRef.h>
+
+namespace dragonvision {
+
+/** One of the cells found in a frame. */
+struct CellTarget {
+  double horizontalAngle = 0.0;
+  double verticalAngle = 0.0;
+  double distance = 0.0;
+  double radius = 0.0;
+  /** Share of the enclosing circle the outline covers, 0 to 1. */
+  double confidence = 0.0;
+  cv::Point2f center;
+  int contourID = 0;
+
+  /**
+   * Where the cell is on the carpet, in inches from the point below the
+   * camera: x along the robot's forward and y to its left (see GroundPlane).
+   * onGround is true if it was located on the ground plane rather than by
+   * its radius (or pose).
+   */
+  double x = 0.0;
+  double y = 0.0;
+  bool onGround = false;
+
+  /**
+   * Camera-frame position of the cell's center (x right, y down, z forward,
+   * inches) and rotation (Rodrigues), when the pipeline estimates poses. If
+   * poseValid is false the fit did not count, and translation is the ray
+   * through the center scaled to distance, with no rotation.
+   */
+  bool poseValid = false;
+  cv::Vec3d translation;
+  cv::Vec3d rotation;
+};
+
+/** What CellPipeline found in one frame. */
+struct CellResult {
+  uint64_t sequence = 0;
+  /** Capture time in wpi::Now() us; 0 if unknown. */
+  uint64_t captureTime = 0;
+  /** Capture to publish, in ms. */
+  double latencyMs = 0.0;
+
+  /** The fields below are only meaningful when found is true. */
+  bool found = false;
+  double horizontalAngle = 0.0;
+  double verticalAngle = 0.0;
+  double distance = 0.0;
+  double radius = 0.0;
+  cv::Point2f center;
+  int contourID = 0;
+  /** Position on the carpet; see CellTarget. */
+  double x = 0.0;
+  double y = 0.0;
+
+  /** Every cell found, best first; at most the pipeline's cap. */
+  wpi::ArrayRef<CellTarget> targets;
+
+  /** True if the targets' poses were estimated and are to be published. */
+  bool poses = false;
+};
+
+/**
+ * Publishes CellResults to a table, one consistent record per frame.
+ *
+ * The whole result goes out as the double array "NearestCell", indexed by
+ * Field, so the robot reads a frame's values together or not at all. The
+ * separate keys CellPipeline has always published are written alongside
+ * for existing robot code. Entries are resolved once.
+ *
+ * The ranked cells go out as the double array "Cells": the sequence, the
+ * count n, then n horizontal angles, n distances, n radii, n confidences,
+ * n x and n y positions.
+ * That is one write per frame however many cells there are, and the
+ * sequence ties it to the frame's "NearestCell" record.
+ *
+ * With poses, the same cells' poses go out the same way as "CellPoses": the
+ * sequence, n, then n each of translation x, y and z, rotation x, y and z,
+ * and 1 or 0 for whether the pose was fitted (see CellTarget::poseValid).
+ *
+ * NetworkTables allocates on every write, so the entries are written and
+ * flushed by a thread of the publisher's own: Publish() only copies the
+ * result into a buffer that is reused from frame to frame. Like
+ * StreamEncoder, it holds a single result; one handed over while the
+ * previous one is still waiting replaces it, and is counted in
+ * "ResultsSkipped". When each write and flush finished is kept for
+ * TakeTiming(), so the pipeline's latency still reaches NetworkTables.
+ */
+class ResultPublisher {
+ public:
+  /** Index of each value in the "NearestCell" array. */
+  enum Field {
+    kSequence,
+    kCaptureTimestamp,  // wpi::Now() us on the coprocessor
+    kLatency,           // capture to publish, ms
+    kFound,             // 1 if a cell was found, 0 if not
+    kHorizontalAngle,
+    kVerticalAngle,
+    kDistance,
+    kRadius,
+    kCenterX,
+    kCenterY,
+    kX,  // on the carpet, inches; see CellTarget
+    kY,
+    kFieldCount
+  };
+
+  explicit ResultPublisher(std::shared_ptr<nt::NetworkTable> table);
+  ~ResultPublisher();
+
+  ResultPublisher(const ResultPublisher&) = delete;
+  ResultPublisher& operator=(const ResultPublisher&) = delete;
+
+  /** Index of the first angle in the "Cells" array. */
+  static constexpr int kCellsHeader = 2;
+
+  /** Columns per cell in the "Cells" array. */
+  static constexpr int kCellsColumns = 6;
+
+  /** Columns per cell in the "CellPoses" array. */
+  static constexpr int kPoseColumns = 7;
+
+  /**
+   * Queues result to be written, the arrays last, and sent right away
+   * instead of at NetworkTables' next periodic update. Call once per frame.
+   */
+  void Publish(const CellResult& result);
+
+  /** When the publishing thread wrote and flushed a result. */
+  struct Timing {
+    uint64_t sequence = 0;
+    /** Of the frame, in wpi::Now() us. */
+    uint64_t captureTime = 0;
+    /** wpi::Now() us when writing started, ended and the flush returned. */
+    uint64_t writeStart = 0;
+    uint64_t written = 0;
+    uint64_t flushed = 0;
+  };
+
+  /**
+   * Takes the timing of the newest result flushed since the last call;
+   * false if none was. Timings of results flushed in between are lost.
+   */
+  bool TakeTiming(Timing& timing);
+
+  /** Results replaced by a newer one before they could be written. */
+  uint64_t GetSkipped() const { return m_skipped; }
+
+  /**
+   * Runs fn on the publishing thread after each result is flushed, e.g. to
+   * publish statistics gathered on the vision thread. Set before the first
+   * Publish().
+   */
+  void SetAfterFlush(std::function<void()> fn) { m_afterFlush = std::move(fn); }
+
+  /**
+   * Stops the publishing thread; a result still waiting is dropped. Call
+   * before anything the SetAfterFlush() function uses goes away.
+   */
+  void Stop();
+
+ private:
+  void Run();
+  void Write(const CellResult& result);
+
+  std::shared_ptr<nt::NetworkTable> m_table;
+  nt::NetworkTableEntry m_record;
+  std::array<double, kFieldCount> m_values{};
+  nt::NetworkTableEntry m_cells;
+  std::vector<double> m_cellValues;
+  nt::NetworkTableEntry m_poses;
+  std::vector<double> m_poseValues;
+
+  nt::NetworkTableEntry m_largestRadius;
+  nt::NetworkTableEntry m_largestCenterX;
+  nt::NetworkTableEntry m_largestCenterY;
+  nt::NetworkTableEntry m_contourID;
+  nt::NetworkTableEntry m_horizontalAngle;
+  nt::NetworkTableEntry m_verticalAngle;
+  nt::NetworkTableEntry m_distance;
+  nt::NetworkTableEntry m_x;
+  nt::NetworkTableEntry m_y;
+  nt::NetworkTableEntry m_captureTimestamp;
+  nt::NetworkTableEntry m_frameSequence;
+  nt::NetworkTableEntry m_pipelineLatency;
+  nt::NetworkTableEntry m_skippedEntry;
+
+  std::function<void()> m_afterFlush;
+  std::atomic<uint64_t> m_skipped{0};
+
+  // Handoff from Publish(), protected by m_mutex; m_pending.targets points
+  // into m_pendingTargets
+  std::mutex m_mutex;
+  std::condition_variable m_resultReady;
+  CellResult m_pending;
+  std::vector<CellTarget> m_pendingTargets;
+  bool m_hasPending = false;
+  bool m_stop = false;
+  Timing m_timing;
+  bool m_hasTiming = false;
+
+  // Only touched by the publishing thread
+  CellResult m_writing;
+  std::vector<CellTarget> m_writingTargets;
+  std::thread m_thread;
+};
+
+}  // namespace dragonvision
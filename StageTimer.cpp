@@ -0,0 +1,233 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "StageTimer.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace dragonvision;
+
+int DurationHistogram::Bin(uint32_t us) {
+  us = std::min<uint32_t>(us, (1u << 24) - 1);
+  if (us < 8) return us;
+  int octave = 31 - __builtin_clz(us);  // 3 to 23
+  int sub = (us >> (octave - 3)) - 8;   // 0 to 7
+  return 8 + (octave - 3) * 8 + sub;
+}
+
+uint32_t DurationHistogram::BinValue(int bin) {
+  if (bin < 8) return bin;
+  int octave = (bin - 8) / 8 + 3;
+  uint32_t sub = (bin - 8) % 8;
+  // middle of the bin
+  return ((16 + 2 * sub + 1) << (octave - 3)) / 2;
+}
+
+void DurationHistogram::Add(uint32_t us) {
+  if (m_count == kWindow) {
+    --m_counts[Bin(m_samples[m_next])];
+  } else {
+    ++m_count;
+  }
+  m_samples[m_next] = us;
+  ++m_counts[Bin(us)];
+  m_next = (m_next + 1) % kWindow;
+}
+
+uint32_t DurationHistogram::Percentile(double p) const {
+  if (m_count == 0) return 0;
+  int rank = std::max(1, static_cast<int>(std::ceil(p * m_count)));
+  int seen = 0;
+  for (int bin = 0; bin < kBins; ++bin) {
+    seen += m_counts[bin];
+    if (seen >= rank) return std::min(BinValue(bin), Max());
+  }
+  return Max();
+}
+
+uint32_t DurationHistogram::Max() const {
+  return *std::max_element(m_samples.begin(), m_samples.begin() + m_count);
+}
+
+#if DRAGONVISION_PERF
+
+void StageTimer::Percentiles::Resolve(nt::NetworkTable& table,
+                                      wpi::StringRef name) {
+  auto sub = table.GetSubTable(name);
+  p50 = sub->GetEntry("p50");
+  p95 = sub->GetEntry("p95");
+  max = sub->GetEntry("max");
+}
+
+void StageTimer::Percentiles::Take() {
+  pending = {histogram.Percentile(0.50) / 1000.0,
+             histogram.Percentile(0.95) / 1000.0, histogram.Max() / 1000.0};
+}
+
+void StageTimer::Percentiles::Publish() {
+  p50.SetDouble(sending[0]);
+  p95.SetDouble(sending[1]);
+  max.SetDouble(sending[2]);
+}
+
+StageTimer::Stage StageTimer::AddStage(wpi::StringRef name) {
+  m_stages.emplace_back();
+  auto& stats = m_stages.back();
+  stats.name = name;
+  if (m_table) stats.duration.Resolve(*m_table, name);
+  if (m_latencyTable) stats.latency.Resolve(*m_latencyTable, name);
+  return static_cast<Stage>(m_stages.size() - 1);
+}
+
+void StageTimer::SetTable(std::shared_ptr<nt::NetworkTable> table,
+                          double rate) {
+  m_table = std::move(table);
+  m_publishPeriod =
+      rate > 0.0 ? std::chrono::duration_cast<Clock::duration>(
+                       std::chrono::duration<double>(1.0 / rate))
+                 : Clock::duration::zero();
+  if (!m_table) return;
+  for (auto& stats : m_stages) stats.duration.Resolve(*m_table, stats.name);
+  m_frame.duration.Resolve(*m_table, m_frame.name);
+  m_fpsEntry = m_table->GetEntry("fps");
+
+  m_publishPool = MatPool::Installed();
+  if (m_publishPool) {
+    auto pool = m_table->GetSubTable("matpool");
+    m_poolLive = pool->GetEntry("liveMB");
+    m_poolPeak = pool->GetEntry("peakMB");
+    m_poolIdle = pool->GetEntry("idleMB");
+    m_poolHits = pool->GetEntry("hits");
+    m_poolMisses = pool->GetEntry("misses");
+  }
+}
+
+void StageTimer::SetLatencyTable(std::shared_ptr<nt::NetworkTable> table) {
+  m_latencyTable = std::move(table);
+  if (!m_latencyTable) return;
+  for (auto& stats : m_stages)
+    stats.latency.Resolve(*m_latencyTable, stats.name);
+  m_frame.latency.Resolve(*m_latencyTable, m_frame.name);
+  m_grab.Resolve(*m_latencyTable, "grab");
+}
+
+void StageTimer::MarkExternal(Stage stage, Clock::duration duration,
+                              uint64_t captureTime, uint64_t endTime) {
+  auto& stats = m_stages[stage];
+  stats.frameTime += duration;
+  // Never marked on this thread, so EndFrame() leaves its latency alone
+  if (m_latencyTable && captureTime != 0 && endTime > captureTime) {
+    stats.latency.histogram.Add(static_cast<uint32_t>(endTime - captureTime));
+  }
+}
+
+void StageTimer::EndFrame() {
+  auto now = Clock::now();
+  auto toUs = [](Clock::duration d) {
+    return static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(d).count());
+  };
+  for (auto& stats : m_stages) {
+    stats.duration.histogram.Add(toUs(stats.frameTime));
+    // a stage that did not run this frame has no end to measure
+    if (m_trackLatency && stats.lastEnd >= m_frameStart) {
+      stats.latency.histogram.Add(
+          toUs(m_startLatency + (stats.lastEnd - m_frameStart)));
+    }
+    stats.totalTime += stats.frameTime;
+    stats.frameTime = Clock::duration::zero();
+  }
+  m_frame.duration.histogram.Add(toUs(now - m_frameStart));
+  m_frame.totalTime += now - m_frameStart;
+  if (m_trackLatency) {
+    m_frame.latency.histogram.Add(toUs(m_startLatency + (now - m_frameStart)));
+    m_grab.histogram.Add(toUs(m_grabLatency));
+  }
+  ++m_frames;
+  ++m_framesSincePublish;
+
+  if (m_table && m_publishPeriod > Clock::duration::zero() &&
+      now - m_lastPublish >= m_publishPeriod) {
+    Take(now);
+  }
+}
+
+std::vector<StageSummary> StageTimer::GetSummary() const {
+  std::vector<StageSummary> summary;
+  auto add = [&](const StageStats& stats) {
+    const auto& h = stats.duration.histogram;
+    const auto& l = stats.latency.histogram;
+    StageSummary s;
+    s.name = stats.name;
+    if (m_frames > 0) {
+      s.meanMs = std::chrono::duration<double, std::milli>(stats.totalTime)
+                     .count() /
+                 m_frames;
+    }
+    s.p50Ms = h.Percentile(0.50) / 1000.0;
+    s.p95Ms = h.Percentile(0.95) / 1000.0;
+    s.maxMs = h.Count() > 0 ? h.Max() / 1000.0 : 0.0;
+    s.latencyP50Ms = l.Percentile(0.50) / 1000.0;
+    s.latencyP95Ms = l.Percentile(0.95) / 1000.0;
+    s.latencyMaxMs = l.Count() > 0 ? l.Max() / 1000.0 : 0.0;
+    summary.push_back(s);
+  };
+  for (const auto& stats : m_stages) add(stats);
+  add(m_frame);
+  return summary;
+}
+
+template <typename F>
+void StageTimer::ForEachPublished(F&& f) {
+  for (auto& stats : m_stages) f(stats.duration);
+  f(m_frame.duration);
+  if (m_latencyTable) {
+    for (auto& stats : m_stages) f(stats.latency);
+    f(m_frame.latency);
+    f(m_grab);
+  }
+}
+
+void StageTimer::Take(Clock::time_point now) {
+  std::scoped_lock lock(m_publishMutex);
+  ForEachPublished([](Percentiles& p) { p.Take(); });
+
+  // The first publish has no interval to measure over
+  m_fpsPending = 0.0;
+  if (m_lastPublish != Clock::time_point{}) {
+    double seconds = std::chrono::duration<double>(now - m_lastPublish).count();
+    m_fpsPending = m_framesSincePublish / seconds;
+  }
+  m_framesSincePublish = 0;
+  m_lastPublish = now;
+
+  if (m_publishPool) m_poolPending = MatPool::Instance().GetStats();
+  m_publishDue = true;
+}
+
+void StageTimer::PublishPending() {
+  {
+    std::scoped_lock lock(m_publishMutex);
+    if (!m_publishDue) return;
+    ForEachPublished([](Percentiles& p) { p.sending = p.pending; });
+    m_fpsSending = m_fpsPending;
+    m_poolSending = m_poolPending;
+    m_publishDue = false;
+  }
+
+  ForEachPublished([](Percentiles& p) { p.Publish(); });
+  if (m_fpsSending > 0.0) m_fpsEntry.SetDouble(m_fpsSending);
+
+  if (m_publishPool) {
+    constexpr double kMB = 1024.0 * 1024.0;
+    m_poolLive.SetDouble(m_poolSending.liveBytes / kMB);
+    m_poolPeak.SetDouble(m_poolSending.peakBytes / kMB);
+    m_poolIdle.SetDouble(m_poolSending.idleBytes / kMB);
+    m_poolHits.SetDouble(m_poolSending.hits);
+    m_poolMisses.SetDouble(m_poolSending.misses);
+  }
+}
+
+#endif
@@ -0,0 +1,246 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+// Build with -DDRAGONVISION_PERF=0 (make PERF=0) to compile every StageTimer
+// call down to nothing.
+#ifndef DRAGONVISION_PERF
+#define DRAGONVISION_PERF 1
+#endif
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <networktables/NetworkTable.h>
+#include <networktables/NetworkTableEntry.h>
+#include <wpi/StringRef.h>
+#include <wpi/timestamp.h>
+
+#include "MatPool.h"
+
+namespace dragonvision {
+
+/**
+ * Durations of the last kWindow samples, binned on a log scale with eight
+ * bins per octave, so percentiles are accurate to about 6%.
+ */
+class DurationHistogram {
+ public:
+  static constexpr int kWindow = 256;
+
+  /** Adds a sample, evicting the oldest one once the window is full. */
+  void Add(uint32_t us);
+
+  /** Approximate p-th percentile (0 to 1) of the window, in us. */
+  uint32_t Percentile(double p) const;
+
+  /** Exact maximum of the window, in us. */
+  uint32_t Max() const;
+
+  int Count() const { return m_count; }
+
+ private:
+  // Values below 8 us get a bin each; above, 8 bins per octave up to 2^24 us
+  static constexpr int kBins = 8 + 21 * 8;
+  static int Bin(uint32_t us);
+  static uint32_t BinValue(int bin);
+
+  std::array<uint16_t, kBins> m_counts{};
+  std::array<uint32_t, kWindow> m_samples{};
+  int m_next = 0;
+  int m_count = 0;
+};
+
+/**
+ * One stage's timing as reported by StageTimer::GetSummary(), in ms.
+ * Percentiles and max cover the last DurationHistogram::kWindow frames; the
+ * mean covers every frame since the timer was created.
+ */
+struct StageSummary {
+  std::string name;
+  double meanMs = 0.0;
+  double p50Ms = 0.0;
+  double p95Ms = 0.0;
+  double maxMs = 0.0;
+
+  // Capture to end of stage, when latency tracking is on
+  double latencyP50Ms = 0.0;
+  double latencyP95Ms = 0.0;
+  double latencyMaxMs = 0.0;
+};
+
+#if DRAGONVISION_PERF
+
+/**
+ * Per-stage frame timing in the spirit of frc::Tracer epochs: Mark() charges
+ * the time since the previous mark to a stage, and a stage may be marked
+ * several times per frame. At EndFrame() each stage's total for the frame
+ * goes into its rolling histogram.
+ *
+ * With a table set, p50, p95 and max of every stage and of the whole frame
+ * (in ms) and the processed fps are published at the configured rate, under
+ * "<stage>/p50" etc. EndFrame() only takes the values; PublishPending()
+ * writes them to NetworkTables, which allocates, so it is meant for a thread
+ * other than the vision thread. Apart from that, not thread safe; one timer
+ * per pipeline.
+ *
+ * With latency tracking on, the timer also keeps how long after the frame's
+ * capture each stage last ended, plus when the runner's grab returned
+ * ("grab"), and publishes those under the latency table the same way.
+ *
+ * While the MatPool is installed, its counters are published alongside
+ * under "matpool/": liveMB, peakMB, idleMB, hits and misses. The pool is
+ * shared by the whole process, so every camera's table shows the same
+ * values.
+ */
+class StageTimer {
+ public:
+  using Stage = int;
+  using Clock = std::chrono::steady_clock;
+
+  /** Registers a stage; call before the first frame. */
+  Stage AddStage(wpi::StringRef name);
+
+  /**
+   * Publish to table rate times per second; 0 stops publishing. Entries are
+   * resolved here, not per frame.
+   */
+  void SetTable(std::shared_ptr<nt::NetworkTable> table, double rate);
+
+  /**
+   * Track capture-to-stage-end latency and publish it to table, at the rate
+   * given to SetTable(). Null turns latency tracking off.
+   */
+  void SetLatencyTable(std::shared_ptr<nt::NetworkTable> table);
+
+  /**
+   * @param captureTime frame capture time in wpi::Now() us; 0 if unknown
+   * @param grabTime    when the grab of the frame returned, same time base
+   */
+  void StartFrame(uint64_t captureTime = 0, uint64_t grabTime = 0) {
+    m_frameStart = m_lastMark = Clock::now();
+    if (m_latencyTable && captureTime != 0) {
+      m_startLatency = std::chrono::microseconds(wpi::Now() - captureTime);
+      m_grabLatency = std::chrono::microseconds(
+          grabTime > captureTime ? grabTime - captureTime : 0);
+      m_trackLatency = true;
+    } else {
+      m_trackLatency = false;
+    }
+  }
+
+  void Mark(Stage stage) {
+    auto now = Clock::now();
+    auto& stats = m_stages[stage];
+    stats.frameTime += now - m_lastMark;
+    stats.lastEnd = now;
+    m_lastMark = now;
+  }
+
+  /**
+   * Charges a stage that ran on another thread, e.g. reported a frame later:
+   * duration goes into this frame's total, and with latency tracking on,
+   * endTime (wpi::Now() us) less captureTime into its latency. Call on the
+   * vision thread between StartFrame() and EndFrame().
+   */
+  void MarkExternal(Stage stage, Clock::duration duration,
+                    uint64_t captureTime, uint64_t endTime);
+
+  void EndFrame();
+
+  /**
+   * Publishes the values taken by the last EndFrame() that was due to
+   * publish, if they have not been published yet. May be called from any
+   * one thread while the vision thread keeps timing frames.
+   */
+  void PublishPending();
+
+  /** Every stage in registration order, then the whole frame as "frame". */
+  std::vector<StageSummary> GetSummary() const;
+
+ private:
+  struct Percentiles {
+    DurationHistogram histogram;
+    nt::NetworkTableEntry p50, p95, max;
+
+    // p50, p95 and max in ms: taken by EndFrame() under m_publishMutex, and
+    // copied from there to be written by PublishPending()
+    std::array<double, 3> pending{}, sending{};
+
+    void Resolve(nt::NetworkTable& table, wpi::StringRef name);
+    void Take();
+    void Publish();
+  };
+
+  struct StageStats {
+    std::string name;
+    Clock::duration frameTime{0};
+    Clock::duration totalTime{0};
+    Clock::time_point lastEnd;
+    Percentiles duration;
+    Percentiles latency;
+  };
+
+  void Take(Clock::time_point now);
+
+  // Runs f on every set of percentiles that is published
+  template <typename F>
+  void ForEachPublished(F&& f);
+
+  std::vector<StageStats> m_stages;
+  StageStats m_frame{"frame"};
+  Clock::time_point m_frameStart;
+  Clock::time_point m_lastMark;
+  uint64_t m_frames = 0;
+
+  std::shared_ptr<nt::NetworkTable> m_latencyTable;
+  bool m_trackLatency = false;
+  Clock::duration m_startLatency{0};
+  Clock::duration m_grabLatency{0};
+  Percentiles m_grab;
+
+  std::shared_ptr<nt::NetworkTable> m_table;
+  Clock::duration m_publishPeriod{0};
+  Clock::time_point m_lastPublish;
+  int m_framesSincePublish = 0;
+  nt::NetworkTableEntry m_fpsEntry;
+
+  bool m_publishPool = false;
+  nt::NetworkTableEntry m_poolLive, m_poolPeak, m_poolIdle, m_poolHits,
+      m_poolMisses;
+
+  // Values taken for PublishPending(), protected by m_publishMutex
+  std::mutex m_publishMutex;
+  bool m_publishDue = false;
+  double m_fpsPending = 0.0, m_fpsSending = 0.0;
+  MatPoolStats m_poolPending, m_poolSending;
+};
+
+#else
+
+class StageTimer {
+ public:
+  using Stage = int;
+
+  Stage AddStage(wpi::StringRef) { return 0; }
+  void SetTable(std::shared_ptr<nt::NetworkTable>, double) {}
+  void SetLatencyTable(std::shared_ptr<nt::NetworkTable>) {}
+  void StartFrame(uint64_t = 0, uint64_t = 0) {}
+  void Mark(Stage) {}
+  void MarkExternal(Stage, std::chrono::steady_clock::duration, uint64_t,
+                    uint64_t) {}
+  void EndFrame() {}
+  void PublishPending() {}
+  std::vector<StageSummary> GetSummary() const { return {}; }
+};
+
+#endif
+
+}  // namespace dragonvision
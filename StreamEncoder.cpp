@@ -0,0 +1,51 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "StreamEncoder.h"
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <utility>
+
+using namespace dragonvision;
+
+StreamEncoder::StreamEncoder(cs::CvSource stream)
+    : m_stream(std::move(stream)), m_thread([this] { Run(); }) {}
+
+StreamEncoder::~StreamEncoder() {
+  {
+    std::scoped_lock lock(m_mutex);
+    m_stop = true;
+  }
+  m_frameReady.notify_one();
+  m_thread.join();
+}
+
+void StreamEncoder::Put(cv::Mat& frame) {
+  {
+    std::scoped_lock lock(m_mutex);
+    // A frame still waiting is stale now; its buffer comes back to the caller
+    std::swap(frame, m_pending);
+    m_hasPending = true;
+  }
+  m_frameReady.notify_one();
+}
+
+void StreamEncoder::Run() {
+  // On Linux, niceness is per thread
+  setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), kNice);
+
+  for (;;) {
+    {
+      std::unique_lock lock(m_mutex);
+      m_frameReady.wait(lock, [this] { return m_hasPending || m_stop; });
+      if (m_stop) return;
+      std::swap(m_encoding, m_pending);
+      m_hasPending = false;
+    }
+    m_stream.PutFrame(m_encoding);
+  }
+}
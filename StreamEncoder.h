@@ -0,0 +1,60 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <opencv2/core/mat.hpp>
+
+#include "cscore_cv.h"
+
+namespace dragonvision {
+
+/**
+ * Puts debug images to a cs::CvSource from a thread of its own, at low
+ * priority, so copying them into cscore and waking the stream servers to
+ * compress them never delays the vision thread.
+ *
+ * The queue holds a single frame: a frame handed over while the previous
+ * one is still waiting replaces it, so a slow encoder shows the newest
+ * overlay instead of falling further and further behind.
+ */
+class StreamEncoder {
+ public:
+  /** Niceness of the encoder thread. */
+  static constexpr int kNice = 19;
+
+  explicit StreamEncoder(cs::CvSource stream);
+  ~StreamEncoder();
+
+  StreamEncoder(const StreamEncoder&) = delete;
+  StreamEncoder& operator=(const StreamEncoder&) = delete;
+
+  /**
+   * Queues frame for the stream. Buffers are swapped, not copied: frame
+   * comes back holding a buffer the encoder is done with (empty at first),
+   * to draw the next frame into.
+   */
+  void Put(cv::Mat& frame);
+
+ private:
+  void Run();
+
+  cs::CvSource m_stream;
+
+  std::mutex m_mutex;
+  std::condition_variable m_frameReady;
+  cv::Mat m_pending;
+  bool m_hasPending = false;
+  bool m_stop = false;
+
+  // Only touched by the encoder thread
+  cv::Mat m_encoding;
+  std::thread m_thread;
+};
+
+}  // namespace dragonvision
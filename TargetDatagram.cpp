@@ -0,0 +1,92 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "TargetDatagram.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace dragonvision;
+
+namespace {
+
+// Byte by byte, so the layout does not depend on the host's byte order
+
+template <typename T>
+uint8_t* PutLE(uint8_t* out, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    *out++ = static_cast<uint8_t>(value >> (8 * i));
+  }
+  return out;
+}
+
+uint8_t* PutFloat(uint8_t* out, float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return PutLE(out, bits);
+}
+
+template <typename T>
+T GetLE(const uint8_t*& in) {
+  T value = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    value |= static_cast<T>(*in++) << (8 * i);
+  }
+  return value;
+}
+
+float GetFloat(const uint8_t*& in) {
+  uint32_t bits = GetLE<uint32_t>(in);
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+}  // namespace
+
+size_t TargetDatagram::Encode(uint8_t* buffer) const {
+  int n = std::clamp(count, 0, kMaxTargets);
+  uint8_t* out = buffer;
+  out = PutLE(out, kMagic);
+  out = PutLE(out, kVersion);
+  out = PutLE(out, static_cast<uint8_t>(n));
+  out = PutLE(out, uint32_t{0});
+  out = PutLE(out, sequence);
+  out = PutLE(out, captureTime);
+  out = PutLE(out, sendTime);
+  for (int i = 0; i < n; ++i) {
+    const Target& target = targets[i];
+    out = PutFloat(out, target.horizontalAngle);
+    out = PutFloat(out, target.verticalAngle);
+    out = PutFloat(out, target.distance);
+    out = PutFloat(out, target.radius);
+    out = PutFloat(out, target.confidence);
+  }
+  return out - buffer;
+}
+
+bool TargetDatagram::Decode(const uint8_t* data, size_t size) {
+  if (size < kHeaderSize) return false;
+  const uint8_t* in = data;
+  if (GetLE<uint16_t>(in) != kMagic || GetLE<uint8_t>(in) != kVersion) {
+    return false;
+  }
+  int n = GetLE<uint8_t>(in);
+  if (n > kMaxTargets || size < kHeaderSize + n * kTargetSize) return false;
+  in += 4;  // reserved
+
+  sequence = GetLE<uint64_t>(in);
+  captureTime = GetLE<uint64_t>(in);
+  sendTime = GetLE<uint64_t>(in);
+  count = n;
+  for (int i = 0; i < n; ++i) {
+    Target& target = targets[i];
+    target.horizontalAngle = GetFloat(in);
+    target.verticalAngle = GetFloat(in);
+    target.distance = GetFloat(in);
+    target.radius = GetFloat(in);
+    target.confidence = GetFloat(in);
+  }
+  return true;
+}
@@ -0,0 +1,70 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace dragonvision {
+
+/**
+ * One frame's targets as sent over UDP by TargetSender and read back by
+ * TargetReceiver. Shared by both ends; depends on nothing but the standard
+ * library, so the robot side can build it as is.
+ *
+ * Wire layout, little-endian, kHeaderSize + count * kTargetSize bytes:
+ *
+ *   offset  size  field
+ *        0     2  magic, kMagic
+ *        2     1  version, kVersion
+ *        3     1  count, 0 to kMaxTargets
+ *        4     4  reserved, 0
+ *        8     8  sequence (uint64)
+ *       16     8  capture time, wpi::Now() us on the coprocessor (uint64)
+ *       24     8  send time, same time base (uint64)
+ *       32        count targets, each five float32: horizontal angle,
+ *                 vertical angle, distance, radius, confidence
+ */
+struct TargetDatagram {
+  static constexpr uint16_t kMagic = 0x5644;  // "DV"
+  static constexpr uint8_t kVersion = 1;
+  static constexpr size_t kHeaderSize = 32;
+  static constexpr size_t kTargetSize = 5 * 4;
+  static constexpr int kMaxTargets = 16;
+  static constexpr size_t kMaxSize = kHeaderSize + kMaxTargets * kTargetSize;
+
+  struct Target {
+    float horizontalAngle = 0.0f;
+    float verticalAngle = 0.0f;
+    float distance = 0.0f;
+    float radius = 0.0f;
+    float confidence = 0.0f;
+  };
+
+  uint64_t sequence = 0;
+  uint64_t captureTime = 0;
+  uint64_t sendTime = 0;
+  int count = 0;
+  std::array<Target, kMaxTargets> targets;
+
+  /**
+   * Writes the datagram to buffer, which must hold kMaxSize bytes. Targets
+   * past kMaxTargets are not sent.
+   *
+   * @return the number of bytes written
+   */
+  size_t Encode(uint8_t* buffer) const;
+
+  /**
+   * Reads a received datagram.
+   *
+   * @return false, leaving this untouched, if data is not a datagram of
+   *         this version
+   */
+  bool Decode(const uint8_t* data, size_t size);
+};
+
+}  // namespace dragonvision
@@ -0,0 +1,52 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "TargetReceiver.h"
+
+#include <algorithm>
+#include <chrono>
+
+using namespace dragonvision;
+
+TargetReceiver::TargetReceiver(int port) : m_client(m_logger) {
+  m_open = m_client.start(port) == 0;
+}
+
+bool TargetReceiver::Receive(TargetDatagram& datagram, double timeout) {
+  if (!m_open) return false;
+
+  using Clock = std::chrono::steady_clock;
+  auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                     std::chrono::duration<double>(timeout));
+  for (;;) {
+    double remaining =
+        std::chrono::duration<double>(deadline - Clock::now()).count();
+    if (remaining <= 0.0) return false;
+    // A timeout that rounds to 0 us would block for good
+    m_client.set_timeout(std::max(remaining, 1e-3));
+
+    int size = m_client.receive(m_buffer, sizeof(m_buffer));
+    if (size <= 0) return false;
+
+    TargetDatagram received;
+    if (!received.Decode(m_buffer, size)) {
+      ++m_discarded;
+      continue;
+    }
+    if (!m_first && received.sequence <= m_lastSequence) {
+      if (m_lastSequence - received.sequence < kRestartGap) {
+        ++m_discarded;
+        continue;
+      }
+      // Far behind: the sender started over
+      m_first = true;
+    }
+    if (!m_first) m_lost += received.sequence - m_lastSequence - 1;
+    m_first = false;
+    m_lastSequence = received.sequence;
+    ++m_received;
+    datagram = received;
+    return true;
+  }
+}
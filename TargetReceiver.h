@@ -0,0 +1,70 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <cstdint>
+
+#include <wpi/Logger.h>
+#include <wpi/UDPClient.h>
+
+#include "TargetDatagram.h"
+
+namespace dragonvision {
+
+/**
+ * Receives the datagrams a TargetSender sends, for the robot side. Needs
+ * only wpiutil; build it from TargetReceiver.cpp and TargetDatagram.cpp
+ * ("make receiver" gives libTargetReceiver.a).
+ *
+ * Datagrams that arrive after a newer one are dropped, and gaps in the
+ * sequence are counted as lost. Not thread safe; one thread receives.
+ */
+class TargetReceiver {
+ public:
+  /**
+   * A sequence this far behind the last one means the sender restarted,
+   * not that the datagram is late.
+   */
+  static constexpr uint64_t kRestartGap = 1000;
+
+  /** Listens on port, on every interface. */
+  explicit TargetReceiver(int port);
+
+  TargetReceiver(const TargetReceiver&) = delete;
+  TargetReceiver& operator=(const TargetReceiver&) = delete;
+
+  /** False if the port could not be opened. */
+  bool IsOpen() const { return m_open; }
+
+  /**
+   * Waits up to timeout seconds for a datagram newer than the last one.
+   *
+   * @return false on timeout, leaving datagram untouched
+   */
+  bool Receive(TargetDatagram& datagram, double timeout);
+
+  /** Datagrams returned by Receive(). */
+  uint64_t GetReceived() const { return m_received; }
+
+  /** Sequence numbers skipped between the datagrams returned. */
+  uint64_t GetLost() const { return m_lost; }
+
+  /** Datagrams dropped for arriving late or not being valid. */
+  uint64_t GetDiscarded() const { return m_discarded; }
+
+ private:
+  wpi::Logger m_logger;
+  wpi::UDPClient m_client;
+  bool m_open = false;
+  uint8_t m_buffer[TargetDatagram::kMaxSize];
+
+  bool m_first = true;
+  uint64_t m_lastSequence = 0;
+  uint64_t m_received = 0;
+  uint64_t m_lost = 0;
+  uint64_t m_discarded = 0;
+};
+
+}  // namespace dragonvision
@@ -0,0 +1,47 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "TargetSender.h"
+
+#include <algorithm>
+
+#include <wpi/raw_ostream.h>
+#include <wpi/timestamp.h>
+
+using namespace dragonvision;
+
+TargetSender::TargetSender(const std::string& host, int port)
+    : m_host(host), m_port(port), m_client(m_logger) {
+  if (m_client.start() != 0) {
+    wpi::errs() << "could not open a UDP socket for " << host << ':' << port
+                << '\n';
+  }
+}
+
+void TargetSender::Send(const CellResult& result) {
+  m_datagram.sequence = result.sequence;
+  m_datagram.captureTime = result.captureTime;
+  m_datagram.count = static_cast<int>(
+      std::min<size_t>(result.targets.size(), TargetDatagram::kMaxTargets));
+  for (int i = 0; i < m_datagram.count; ++i) {
+    const CellTarget& target = result.targets[i];
+    auto& out = m_datagram.targets[i];
+    out.horizontalAngle = static_cast<float>(target.horizontalAngle);
+    out.verticalAngle = static_cast<float>(target.verticalAngle);
+    out.distance = static_cast<float>(target.distance);
+    out.radius = static_cast<float>(target.radius);
+    out.confidence = static_cast<float>(target.confidence);
+  }
+  m_datagram.sendTime = wpi::Now();
+
+  size_t size = m_datagram.Encode(m_buffer);
+  if (m_client.send(wpi::ArrayRef<uint8_t>(m_buffer, size), m_host, m_port) !=
+      static_cast<int>(size)) {
+    // Report the first failure only; a missing receiver would flood the log
+    if (m_sendErrors++ == 0) {
+      wpi::errs() << "could not send targets to " << m_host << ':' << m_port
+                  << '\n';
+    }
+  }
+}
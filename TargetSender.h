@@ -0,0 +1,50 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <wpi/Logger.h>
+#include <wpi/UDPClient.h>
+
+#include "ResultPublisher.h"
+#include "TargetDatagram.h"
+
+namespace dragonvision {
+
+/**
+ * Sends each frame's targets as one TargetDatagram to a fixed host and
+ * port, straight from the calling thread. Unlike NetworkTables there is no
+ * update timer to wait for; the datagram is on the wire when Send()
+ * returns.
+ */
+class TargetSender {
+ public:
+  /**
+   * @param host IP address of the receiver (not a host name)
+   * @param port UDP port of the receiver
+   */
+  TargetSender(const std::string& host, int port);
+
+  TargetSender(const TargetSender&) = delete;
+  TargetSender& operator=(const TargetSender&) = delete;
+
+  /** Sends result's targets, up to TargetDatagram::kMaxTargets. */
+  void Send(const CellResult& result);
+
+  uint64_t GetSendErrors() const { return m_sendErrors; }
+
+ private:
+  std::string m_host;
+  int m_port;
+  wpi::Logger m_logger;
+  wpi::UDPClient m_client;
+  TargetDatagram m_datagram;
+  uint8_t m_buffer[TargetDatagram::kMaxSize];
+  uint64_t m_sendErrors = 0;
+};
+
+}  // namespace dragonvision
@@ -0,0 +1,78 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <vision/VisionPipeline.h>
+#include <wpi/timestamp.h>
+
+#include "cscore_cpp.h"
+#include "StageTimer.h"
+
+namespace dragonvision {
+
+/**
+ * Describes where a frame came from.
+ */
+struct FrameInfo {
+  /**
+   * Capture time as returned by cs::CvSink::GrabFrame(); same time base as
+   * wpi::Now(), in 1 us increments.
+   */
+  uint64_t captureTime = 0;
+
+  /**
+   * Capture sequence number, starting at 1. Gaps mean frames were dropped
+   * between captures that were processed.
+   */
+  uint64_t sequence = 0;
+
+  /**
+   * Layout of the image handed to Process(): kBGR for a CV_8UC3 BGR image,
+   * kYUYV for a packed CV_8UC2 YUYV image.
+   */
+  cs::VideoMode::PixelFormat pixelFormat = cs::VideoMode::kBGR;
+
+  /**
+   * wpi::Now() when the runner's grab of this frame returned (including any
+   * decoding); 0 if unknown.
+   */
+  uint64_t grabTime = 0;
+};
+
+/**
+ * A vision pipeline that is told when its input frame was captured, so that
+ * results can be published together with their age.
+ *
+ * @see PipelineRunner
+ */
+class TimedVisionPipeline : public frc::VisionPipeline {
+ public:
+  /**
+   * Processes the image input captured at {@code frame.captureTime}.
+   */
+  virtual void Process(cv::Mat& mat, const FrameInfo& frame) = 0;
+
+  /**
+   * Untimed entry point for runners that do not know the capture time; the
+   * frame is treated as captured now.
+   */
+  void Process(cv::Mat& mat) override {
+    Process(mat, FrameInfo{wpi::Now(), ++m_untimedSequence, cs::VideoMode::kBGR});
+  }
+
+  /**
+   * Per-stage timing of the frames processed so far, for benchmarks; empty
+   * if the pipeline does not time its stages.
+   */
+  virtual std::vector<StageSummary> GetStageSummary() const { return {}; }
+
+ private:
+  uint64_t m_untimedSequence = 0;
+};
+
+}  // namespace dragonvision
@@ -0,0 +1,1766 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+// Offline benchmarks for the vision code. Needs no camera and no
+// NetworkTables server; run VisionBench without arguments for the list.
+//
+// "VisionBench alloc" counts heap allocations, so malloc and friends are
+// replaced in this program (see the bottom of this file).
+//
+// "VisionBench replay" runs a registered pipeline over a directory of images
+// or a video file and prints throughput, frame latency and the per-stage
+// breakdown as JSON on stdout.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <networktables/NetworkTableInstance.h>
+#include <wpi/json.h>
+#include <wpi/raw_istream.h>
+#include <wpi/raw_ostream.h>
+#include <wpi/timestamp.h>
+
+#include "CameraModel.h"
+#include "CellPipeline.h"
+#include "ColorThreshold.h"
+#include "ContourFinder.h"
+#include "GroundPlane.h"
+#include "MatPool.h"
+#include "PipelineRunner.h"
+#include "PoseEstimator.h"
+#include "ProcessingScheduler.h"
+#include "TargetReceiver.h"
+#include "VisionConfig.h"
+
+using namespace dragonvision;
+
+namespace {
+
+  struct Resolution {
+    int width;
+    int height;
+  };
+
+  const Resolution kResolutions[] = {{320, 240}, {640, 480}};
+
+  int iterations = 200;
+
+  // An image directory or video after the iteration count, for benchmarks
+  // that can also run on recorded frames.
+  const char* benchInput = nullptr;
+
+  // Heap allocations made by this thread while counting is on. Everything
+  // in the process allocates through the malloc family defined below:
+  // operator new, OpenCV's fastMalloc, ntcore and cscore alike.
+  thread_local bool tCountAllocations = false;
+  thread_local uint64_t tAllocations = 0;
+
+  // Average wall time of fn() in microseconds, after one warm-up call.
+  double TimeUs(const std::function<void()>& fn) {
+    fn();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::micro>(elapsed).count() /
+           iterations;
+  }
+
+  // The synthetic frames have four cells; the last one is the largest.
+  constexpr int kCellCount = 4;
+
+  cv::Point CellCenter(const Resolution& res, int i) {
+    return {res.width * (i + 1) / 5, res.height * (i % 2 + 1) / 3};
+  }
+
+  int CellRadius(int i) { return 10 + 5 * i; }
+
+  double Percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(1, rank)) - 1];
+  }
+
+  // A noisy frame with a few cell-colored discs on it, packed as YUYV.
+  cv::Mat MakeYuyvFrame(const Resolution& res) {
+    cv::Mat planes[3];
+    const cv::Scalar background{110, 128, 128};
+    const cv::Scalar cell{151, 43, 202};  // roughly BGR (0, 128, 255)
+    for (int p = 0; p < 3; ++p) {
+      planes[p].create(res.height, res.width, CV_8U);
+      cv::randn(planes[p], background[p], 25);
+      for (int i = 0; i < kCellCount; ++i) {
+        cv::circle(planes[p], CellCenter(res, i), CellRadius(i), cell[p],
+                   cv::FILLED);
+      }
+    }
+
+    cv::Mat yuyv(res.height, res.width, CV_8UC2);
+    for (int r = 0; r < res.height; ++r) {
+      auto y = planes[0].ptr<uchar>(r);
+      auto u = planes[1].ptr<uchar>(r);
+      auto v = planes[2].ptr<uchar>(r);
+      auto out = yuyv.ptr<uchar>(r);
+      for (int c = 0; c < res.width; c += 2, out += 4) {
+        out[0] = y[c];
+        out[1] = u[c];
+        out[2] = y[c + 1];
+        out[3] = v[c];
+      }
+    }
+    return yuyv;
+  }
+
+  cv::Mat MakeBgrFrame(const Resolution& res) {
+    cv::Mat bgr;
+    cv::cvtColor(MakeYuyvFrame(res), bgr, cv::COLOR_YUV2BGR_YUYV);
+    return bgr;
+  }
+
+  // Where the cells really are in MakeYuyvFrame() and MakeBgrFrame().
+  cv::Mat MakeCellMask(const Resolution& res) {
+    cv::Mat mask = cv::Mat::zeros(res.height, res.width, CV_8U);
+    for (int i = 0; i < kCellCount; ++i)
+      cv::circle(mask, CellCenter(res, i), CellRadius(i), 255, cv::FILLED);
+    return mask;
+  }
+
+  // The "camera model" the geometry benchmarks project through: a 640x480
+  // calibration with noticeable barrel distortion.
+  CameraIntrinsics MakeBenchCameraModel() {
+    CameraIntrinsics calibration;
+    calibration.size = {640, 480};
+    calibration.fx = calibration.fy = 520.0;
+    calibration.cx = 319.5;
+    calibration.cy = 239.5;
+    calibration.distortion = {-0.25, 0.08, 0.001, 0.001, 0.0};
+    return calibration;
+  }
+
+  // A CellPipeline for res-sized frames, with an unwatched debug stream.
+  CellPipeline MakeBenchPipeline(
+      const Resolution& res, const CellPipelineSettings& settings = {},
+      std::shared_ptr<nt::NetworkTable> table =
+          nt::NetworkTableInstance::GetDefault().GetTable("VisionBench")) {
+    return CellPipeline(
+        cs::CvSource("bench", cs::VideoMode::kBGR, res.width, res.height, 30),
+        std::move(table), settings);
+  }
+
+  int BenchYuyv() {
+    ColorThresholdParams params;
+    cv::Mat gammaTable = MakeGammaTable(params.gamma);
+
+    YuyvThresholdTable table;
+    auto start = std::chrono::steady_clock::now();
+    table.Build(params);
+    auto buildMs = std::chrono::duration<double, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+    std::printf("yuyv table build: %.1f ms\n", buildMs);
+
+    std::printf("%-9s %14s %14s %8s %12s %12s\n", "size", "bgr chain us",
+                "yuyv table us", "speedup", "raw diff px", "blur diff px");
+    for (const auto& res : kResolutions) {
+      cv::Mat yuyv = MakeYuyvFrame(res);
+      cv::Mat bgr, gammaScratch, hsv, hsvBlur, bgrMask, rawMask, rawMaskBlur,
+          tableMask;
+
+      // What CellPipeline does with a YUYV camera today: cscore converts to
+      // BGR, then LUT, BGR2HSV, median blur on HSV, inRange.
+      double chainUs = TimeUs([&] {
+        cv::cvtColor(yuyv, bgr, cv::COLOR_YUV2BGR_YUYV);
+        cv::LUT(bgr, gammaTable, gammaScratch);
+        cv::cvtColor(gammaScratch, hsv, cv::COLOR_BGR2HSV);
+        cv::medianBlur(hsv, hsvBlur, 7);
+        cv::inRange(hsvBlur, params.hsvLow, params.hsvHigh, bgrMask);
+      });
+
+      // The "native" frame format path: table lookup, median blur on the mask.
+      double tableUs = TimeUs([&] {
+        table.Apply(yuyv, tableMask);
+        cv::medianBlur(tableMask, rawMaskBlur, 7);
+      });
+
+      // The unblurred masks must match exactly; blurring the HSV image versus
+      // the mask is allowed to differ along edges.
+      cv::cvtColor(yuyv, bgr, cv::COLOR_YUV2BGR_YUYV);
+      ThresholdBgr(bgr, gammaTable, params, gammaScratch, hsv, rawMask);
+      int rawDiff = cv::countNonZero(rawMask != tableMask);
+      int blurDiff = cv::countNonZero(bgrMask != rawMaskBlur);
+
+      char size[16];
+      std::snprintf(size, sizeof(size), "%dx%d", res.width, res.height);
+      std::printf("%-9s %14.1f %14.1f %7.2fx %12d %12d\n", size, chainUs,
+                  tableUs, chainUs / tableUs, rawDiff, blurDiff);
+      if (rawDiff != 0) {
+        wpi::errs() << "yuyv table does not match the BGR chain\n";
+        return EXIT_FAILURE;
+      }
+    }
+    return EXIT_SUCCESS;
+  }
+
+  int BenchFused() {
+    ColorThresholdParams params;
+    cv::Mat gammaTable = MakeGammaTable(params.gamma);
+    FusedColorThreshold fused;
+    fused.SetParams(params);
+    cv::Mat gammaScratch, hsv, chainMask, fusedMask, scalarMask;
+
+    // Every BGR triple, one 256x256 (G, R) image per B value
+    long long simdDiff = 0, scalarDiff = 0;
+    cv::Mat cube(256, 256, CV_8UC3);
+    for (int b = 0; b < 256; ++b) {
+      for (int g = 0; g < 256; ++g) {
+        auto row = cube.ptr<cv::Vec3b>(g);
+        for (int r = 0; r < 256; ++r) row[r] = cv::Vec3b(b, g, r);
+      }
+      ThresholdBgr(cube, gammaTable, params, gammaScratch, hsv, chainMask);
+      fused.Apply(cube, fusedMask);
+      fused.ApplyScalar(cube, scalarMask);
+      simdDiff += cv::countNonZero(chainMask != fusedMask);
+      scalarDiff += cv::countNonZero(chainMask != scalarMask);
+    }
+    std::printf("all 2^24 BGR values: simd diff %lld, scalar diff %lld\n",
+                simdDiff, scalarDiff);
+
+    std::printf("%-9s %12s %12s %14s %8s\n", "size", "chain us", "fused us",
+                "fused scalar us", "speedup");
+    for (const auto& res : kResolutions) {
+      cv::Mat bgr = MakeBgrFrame(res);
+      double chainUs = TimeUs([&] {
+        ThresholdBgr(bgr, gammaTable, params, gammaScratch, hsv, chainMask);
+      });
+      double fusedUs = TimeUs([&] { fused.Apply(bgr, fusedMask); });
+      double scalarUs = TimeUs([&] { fused.ApplyScalar(bgr, scalarMask); });
+
+      char size[16];
+      std::snprintf(size, sizeof(size), "%dx%d", res.width, res.height);
+      std::printf("%-9s %12.1f %12.1f %14.1f %7.2fx\n", size, chainUs, fusedUs,
+                  scalarUs, chainUs / fusedUs);
+    }
+
+    if (simdDiff != 0 || scalarDiff != 0) {
+      wpi::errs() << "fused threshold is not bit-exact with the chain\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  int BenchLut() {
+    ColorThresholdParams params;
+    cv::Mat gammaTable = MakeGammaTable(params.gamma);
+    cv::Mat gammaScratch, hsv, chainMask, lutMask;
+
+    cv::Mat cube(256, 256, CV_8UC3);
+
+    std::printf("%-9s %4s %10s %12s %10s %10s %8s\n", "size", "bits",
+                "build ms", "cube diff", "chain us", "lut us", "speedup");
+    bool exact = true;
+    for (int bits = 8; bits >= BgrThresholdLut::kMinBitsPerChannel; --bits) {
+      BgrThresholdLut lut(bits);
+      auto start = std::chrono::steady_clock::now();
+      lut.Build(params);
+      auto buildMs = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+      // Every BGR triple, one 256x256 (G, R) image per B value
+      long long cubeDiff = 0;
+      for (int b = 0; b < 256; ++b) {
+        for (int g = 0; g < 256; ++g) {
+          auto row = cube.ptr<cv::Vec3b>(g);
+          for (int r = 0; r < 256; ++r) row[r] = cv::Vec3b(b, g, r);
+        }
+        ThresholdBgr(cube, gammaTable, params, gammaScratch, hsv, chainMask);
+        lut.Apply(cube, lutMask);
+        cubeDiff += cv::countNonZero(chainMask != lutMask);
+      }
+      if (bits == 8 && cubeDiff != 0) exact = false;
+
+      for (const auto& res : kResolutions) {
+        cv::Mat bgr = MakeBgrFrame(res);
+        double chainUs = TimeUs([&] {
+          ThresholdBgr(bgr, gammaTable, params, gammaScratch, hsv, chainMask);
+        });
+        double lutUs = TimeUs([&] { lut.Apply(bgr, lutMask); });
+
+        char size[16];
+        std::snprintf(size, sizeof(size), "%dx%d", res.width, res.height);
+        std::printf("%-9s %4d %10.1f %12lld %10.1f %10.1f %7.2fx\n", size,
+                    bits, buildMs, cubeDiff, chainUs, lutUs, chainUs / lutUs);
+      }
+    }
+
+    // Background rebuild: frames keep being thresholded with the old table
+    // until the new one is swapped in
+    BgrThresholdLut lut;
+    lut.Build(params);
+    ColorThresholdParams tuned = params;
+    tuned.hsvLow[0] = 20;
+    cv::Mat bgr = MakeBgrFrame(kResolutions[0]);
+    int framesDuringRebuild = 0;
+    auto start = std::chrono::steady_clock::now();
+    lut.SetParams(tuned);
+    while (lut.GetParams() != tuned) {
+      lut.Apply(bgr, lutMask);
+      ++framesDuringRebuild;
+    }
+    auto swapMs = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    std::printf("background rebuild: swapped after %.1f ms, %d frames "
+                "thresholded meanwhile\n",
+                swapMs, framesDuringRebuild);
+
+    if (!exact) {
+      wpi::errs() << "8 bit lut is not bit-exact with the chain\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  int BenchDenoise() {
+    using DenoiseMethod = CellPipelineSettings::DenoiseMethod;
+    struct Method {
+      const char* name;
+      DenoiseMethod denoise;
+    };
+    const Method methods[] = {
+        {"hsv median", DenoiseMethod::kHsvMedian},
+        {"hsv box", DenoiseMethod::kHsvBox},
+        {"mask median", DenoiseMethod::kMaskMedian},
+        {"mask majority", DenoiseMethod::kMaskMajority},
+        {"none", DenoiseMethod::kNone},
+    };
+
+    ColorThresholdParams params;
+    cv::Mat gammaTable = MakeGammaTable(params.gamma);
+    cv::Mat gammaScratch, hsv, hsvBlur, rawMask, maskSum;
+
+    // Stage: threshold plus denoise. Accuracy: pixels that differ from the
+    // true cell discs and from the original HSV median, and how far the
+    // whole pipeline's nearest cell is from the largest true cell.
+    std::printf("%-9s %-14s %10s %8s %10s %12s %10s %10s %10s\n", "size",
+                "denoise", "stage us", "speedup", "frame us", "vs truth px",
+                "vs hsv px", "center dx", "radius dx");
+    bool majorityExact = true;
+    for (const auto& res : kResolutions) {
+      cv::Mat bgr = MakeBgrFrame(res);
+      cv::Mat truth = MakeCellMask(res);
+      const cv::Point2f trueCenter = CellCenter(res, kCellCount - 1);
+      const float trueRadius = CellRadius(kCellCount - 1);
+
+      cv::Mat reference, maskMedian;
+      double referenceUs = 0.0;
+      for (const auto& method : methods) {
+        cv::Mat mask;
+        auto stage = [&] {
+          cv::LUT(bgr, gammaTable, gammaScratch);
+          cv::cvtColor(gammaScratch, hsv, cv::COLOR_BGR2HSV);
+          switch (method.denoise) {
+            case DenoiseMethod::kHsvMedian:
+              cv::medianBlur(hsv, hsvBlur, 7);
+              cv::inRange(hsvBlur, params.hsvLow, params.hsvHigh, mask);
+              break;
+            case DenoiseMethod::kHsvBox:
+              cv::blur(hsv, hsvBlur, cv::Size(7, 7));
+              cv::inRange(hsvBlur, params.hsvLow, params.hsvHigh, mask);
+              break;
+            case DenoiseMethod::kMaskMedian:
+              cv::inRange(hsv, params.hsvLow, params.hsvHigh, rawMask);
+              cv::medianBlur(rawMask, mask, 7);
+              break;
+            case DenoiseMethod::kMaskMajority:
+              cv::inRange(hsv, params.hsvLow, params.hsvHigh, rawMask);
+              MajorityFilter(rawMask, 7, maskSum, mask);
+              break;
+            case DenoiseMethod::kNone:
+              cv::inRange(hsv, params.hsvLow, params.hsvHigh, mask);
+              break;
+          }
+        };
+        double stageUs = TimeUs(stage);
+        if (method.denoise == DenoiseMethod::kHsvMedian) {
+          reference = mask.clone();
+          referenceUs = stageUs;
+        }
+        if (method.denoise == DenoiseMethod::kMaskMedian)
+          maskMedian = mask.clone();
+        if (method.denoise == DenoiseMethod::kMaskMajority &&
+            cv::countNonZero(mask != maskMedian) != 0)
+          majorityExact = false;
+
+        CellPipelineSettings settings;
+        settings.denoise = method.denoise;
+        CellPipeline pipeline = MakeBenchPipeline(res, settings);
+        FrameInfo frame;
+        double frameUs = TimeUs([&] {
+          ++frame.sequence;
+          pipeline.Process(bgr, frame);
+        });
+
+        char size[16];
+        std::snprintf(size, sizeof(size), "%dx%d", res.width, res.height);
+        std::printf(
+            "%-9s %-14s %10.1f %7.2fx %10.1f %12d %10d %10.2f %10.2f\n", size,
+            method.name, stageUs, referenceUs / stageUs, frameUs,
+            cv::countNonZero(mask != truth), cv::countNonZero(mask != reference),
+            cv::norm(pipeline.GetNearestCellCenter() - trueCenter),
+            std::abs(pipeline.GetNearestCellRadius() - trueRadius));
+      }
+    }
+
+    if (!majorityExact) {
+      wpi::errs() << "mask majority does not match mask median\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Runs CellPipeline with latency tracking against an NT server on loopback
+  // and compares its own numbers with when a client actually sees the values.
+  int BenchLatency() {
+#if !DRAGONVISION_PERF
+    wpi::errs() << "latency tracking is compiled out (PERF=0)\n";
+    return EXIT_FAILURE;
+#else
+    constexpr unsigned int kPort = 5811;  // clear of a real server on 1735
+    constexpr int kFrames = 200;
+    constexpr auto kFramePeriod = std::chrono::milliseconds(20);
+
+    auto server = nt::NetworkTableInstance::Create();
+    auto client = nt::NetworkTableInstance::Create();
+    server.StartServer("VisionBench-networktables.ini", "127.0.0.1", kPort);
+    client.StartClient("127.0.0.1", kPort);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!client.IsConnected() && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (!client.IsConnected()) {
+      wpi::errs() << "client could not connect to 127.0.0.1:" << kPort << '\n';
+      return EXIT_FAILURE;
+    }
+
+    // Each frame's record carries its own capture timestamp
+    std::mutex mutex;
+    std::vector<double> receivedMs;
+    auto clientTable = client.GetTable("VisionBench/latency");
+    clientTable->GetEntry("NearestCell")
+        .AddListener(
+            [&](const nt::EntryNotification& event) {
+              auto record = event.value->GetDoubleArray();
+              if (record.size() < ResultPublisher::kFieldCount) return;
+              double ms =
+                  (wpi::Now() - record[ResultPublisher::kCaptureTimestamp]) /
+                  1000.0;
+              std::scoped_lock lock(mutex);
+              receivedMs.push_back(ms);
+            },
+            NT_NOTIFY_NEW | NT_NOTIFY_UPDATE);
+
+    CellPipelineSettings settings;
+    settings.latency = true;
+    const auto& res = kResolutions[0];
+    CellPipeline pipeline = MakeBenchPipeline(
+        res, settings, server.GetTable("VisionBench/latency"));
+    cv::Mat bgr = MakeBgrFrame(res);
+
+    FrameInfo frame;
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 0; i < kFrames; ++i) {
+      // slower than NT's 10 ms minimum flush interval, like a real camera
+      std::this_thread::sleep_until(next += kFramePeriod);
+      frame.captureTime = frame.grabTime = wpi::Now();
+      ++frame.sequence;
+      pipeline.Process(bgr, frame);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::vector<double> received;
+    {
+      std::scoped_lock lock(mutex);
+      received = receivedMs;
+    }
+    std::sort(received.begin(), received.end());
+
+    double writeMs = 0.0, flushMs = 0.0;
+    std::printf("%-14s %10s %10s %10s\n", "capture to", "p50 ms", "p95 ms",
+                "max ms");
+    for (const auto& stage : pipeline.GetStageSummary()) {
+      if (stage.name == "publish") writeMs = stage.latencyP50Ms;
+      if (stage.name == "flush") flushMs = stage.latencyP50Ms;
+      std::printf("%-14s %10.3f %10.3f %10.3f\n", stage.name.c_str(),
+                  stage.latencyP50Ms, stage.latencyP95Ms, stage.latencyMaxMs);
+    }
+    double receivedP50 = Percentile(received, 0.50);
+    std::printf("%-14s %10.3f %10.3f %10.3f\n", "client", receivedP50,
+                Percentile(received, 0.95),
+                received.empty() ? 0.0 : received.back());
+    std::printf("client saw %zu of %d frames\n", received.size(), kFrames);
+
+    // The client can only see a value after it was written and flushed, and
+    // on loopback it should not take much longer than that. The pipeline's
+    // percentiles come from histogram bins, good to about 6%. At one frame
+    // per 20 ms the publisher never falls behind, so none may be skipped.
+    bool ok = received.size() >= kFrames * 9 / 10 && writeMs <= flushMs &&
+              flushMs <= receivedP50 * 1.07 && receivedP50 - flushMs < 20.0 &&
+              pipeline.GetResultsSkipped() == 0;
+    if (!ok) {
+      wpi::errs() << "loopback latency does not agree with the pipeline's\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+#endif
+  }
+
+  int BenchPyramid() {
+    std::printf("%-9s %6s %10s %8s %12s %12s\n", "size", "levels", "frame us",
+                "speedup", "center dx px", "radius dx px");
+    bool withinTolerance = true;
+    for (const auto& res : kResolutions) {
+      cv::Mat bgr = MakeBgrFrame(res);
+      FrameInfo frame;
+      double fullUs = 0.0;
+      cv::Point2f fullCenter;
+      float fullRadius = 0.0f;
+
+      for (int levels = 0; levels <= CellPipelineSettings::kMaxPyramidLevels;
+           ++levels) {
+        CellPipelineSettings settings;
+        settings.pyramidLevels = levels;
+        CellPipeline pipeline = MakeBenchPipeline(res, settings);
+        double us = TimeUs([&] {
+          ++frame.sequence;
+          pipeline.Process(bgr, frame);
+        });
+
+        auto center = pipeline.GetNearestCellCenter();
+        auto radius = pipeline.GetNearestCellRadius();
+        if (levels == 0) {
+          fullUs = us;
+          fullCenter = center;
+          fullRadius = radius;
+        }
+        double centerDiff = cv::norm(center - fullCenter);
+        double radiusDiff = std::abs(radius - fullRadius);
+
+        // the tolerance is only promised for cells of at least 4 << levels px
+        if (fullRadius >= (4 << levels) &&
+            (centerDiff > CellPipelineSettings::kPyramidTolerance ||
+             radiusDiff > CellPipelineSettings::kPyramidTolerance))
+          withinTolerance = false;
+
+        char size[16];
+        std::snprintf(size, sizeof(size), "%dx%d", res.width, res.height);
+        std::printf("%-9s %6d %10.1f %7.2fx %12.2f %12.2f\n", size, levels, us,
+                    fullUs / us, centerDiff, radiusDiff);
+      }
+    }
+    if (!withinTolerance) {
+      wpi::errs() << "pyramid result outside tolerance of "
+                  << CellPipelineSettings::kPyramidTolerance << " px\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Allocations per steady-state frame on the vision thread, in
+  // CellPipeline::Detect() and Draw() and in the whole Process(), which must
+  // be none for the settings that avoid OpenCV's allocating filters. NetworkTables allocates too, but on the publisher's
+  // thread, which is not counted.
+  int BenchAlloc() {
+    using ThresholdMethod = CellPipelineSettings::ThresholdMethod;
+    using DenoiseMethod = CellPipelineSettings::DenoiseMethod;
+    struct Config {
+      const char* name;
+      bool yuyv;
+      ThresholdMethod threshold;
+      DenoiseMethod denoise;
+      int pyramidLevels;
+      bool roiTracking;
+      bool allocationFree;
+    };
+    const Config configs[] = {
+        {"fused majority", false, ThresholdMethod::kFused,
+         DenoiseMethod::kMaskMajority, 0, false, true},
+        {"fused none", false, ThresholdMethod::kFused, DenoiseMethod::kNone, 0,
+         false, true},
+        {"lut majority", false, ThresholdMethod::kLut,
+         DenoiseMethod::kMaskMajority, 0, false, true},
+        {"fused roi", false, ThresholdMethod::kFused,
+         DenoiseMethod::kMaskMajority, 0, true, true},
+        {"yuyv majority", true, ThresholdMethod::kChain,
+         DenoiseMethod::kMaskMajority, 0, false, true},
+        {"yuyv pyramid roi", true, ThresholdMethod::kChain,
+         DenoiseMethod::kMaskMajority, 2, true, true},
+        // medianBlur, blur and pyrDown allocate inside OpenCV
+        {"chain hsv median", false, ThresholdMethod::kChain,
+         DenoiseMethod::kHsvMedian, 0, false, false},
+        {"fused mask median", false, ThresholdMethod::kFused,
+         DenoiseMethod::kMaskMedian, 0, false, false},
+        {"fused pyramid", false, ThresholdMethod::kFused,
+         DenoiseMethod::kMaskMajority, 2, false, false},
+    };
+    // Frames with different noise, so contour counts and window sizes vary
+    constexpr int kFrames = 8;
+    constexpr int kWarmupPasses = 3;
+
+    std::printf("%-9s %-18s %6s %14s %12s %14s\n", "size", "settings",
+                "frames", "detect+draw", "worst frame", "process/frame");
+    bool ok = true;
+    for (const auto& res : kResolutions) {
+      std::vector<cv::Mat> yuyvFrames, bgrFrames;
+      for (int i = 0; i < kFrames; ++i) {
+        yuyvFrames.push_back(MakeYuyvFrame(res));
+        bgrFrames.emplace_back();
+        cv::cvtColor(yuyvFrames.back(), bgrFrames.back(),
+                     cv::COLOR_YUV2BGR_YUYV);
+      }
+
+      for (const auto& config : configs) {
+        CellPipelineSettings settings;
+        settings.threshold = config.threshold;
+        settings.denoise = config.denoise;
+        settings.pyramidLevels = config.pyramidLevels;
+        settings.roiTracking = config.roiTracking;
+        CellPipeline pipeline = MakeBenchPipeline(res, settings);
+        auto& frames = config.yuyv ? yuyvFrames : bgrFrames;
+        FrameInfo frame;
+        frame.pixelFormat =
+            config.yuyv ? cs::VideoMode::kYUYV : cs::VideoMode::kBGR;
+
+        for (int i = 0; i < kWarmupPasses * kFrames; ++i) {
+          ++frame.sequence;
+          pipeline.Process(frames[i % kFrames], frame);
+        }
+
+        uint64_t total = 0, worst = 0;
+        for (int i = 0; i < iterations; ++i) {
+          ++frame.sequence;
+          tAllocations = 0;
+          tCountAllocations = true;
+          pipeline.Detect(frames[i % kFrames], frame);
+          pipeline.Draw();
+          tCountAllocations = false;
+          total += tAllocations;
+          worst = std::max(worst, tAllocations);
+        }
+
+        uint64_t processTotal = 0;
+        for (int i = 0; i < iterations; ++i) {
+          ++frame.sequence;
+          tAllocations = 0;
+          tCountAllocations = true;
+          pipeline.Process(frames[i % kFrames], frame);
+          tCountAllocations = false;
+          processTotal += tAllocations;
+        }
+        double processPerFrame =
+            static_cast<double>(processTotal) / iterations;
+
+        bool failed =
+            config.allocationFree && (total != 0 || processTotal != 0);
+        char size[16];
+        std::snprintf(size, sizeof(size), "%dx%d", res.width, res.height);
+        std::printf("%-9s %-18s %6d %14llu %12llu %14.2f%s\n", size,
+                    config.name, iterations,
+                    static_cast<unsigned long long>(total),
+                    static_cast<unsigned long long>(worst), processPerFrame,
+                    failed ? "  FAIL" : "");
+        if (failed) ok = false;
+      }
+    }
+
+    if (!ok) {
+      wpi::errs() << "a steady-state frame allocated\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Sends CellPipeline's targets to a TargetReceiver on loopback and
+  // measures send-to-receive latency and loss.
+  int BenchUdp() {
+    constexpr int kPort = 5812;
+    constexpr int kFrames = 200;
+    constexpr auto kFramePeriod = std::chrono::milliseconds(20);
+
+    TargetReceiver receiver(kPort);
+    if (!receiver.IsOpen()) {
+      wpi::errs() << "could not listen on UDP port " << kPort << '\n';
+      return EXIT_FAILURE;
+    }
+
+    std::atomic<bool> done{false};
+    std::vector<double> sendToReceiveMs, captureToReceiveMs;
+    int lastCount = -1;
+    std::thread receiveThread([&] {
+      TargetDatagram datagram;
+      while (!done) {
+        if (!receiver.Receive(datagram, 0.1)) continue;
+        uint64_t now = wpi::Now();
+        sendToReceiveMs.push_back((now - datagram.sendTime) / 1000.0);
+        captureToReceiveMs.push_back((now - datagram.captureTime) / 1000.0);
+        lastCount = datagram.count;
+      }
+    });
+
+    CellPipelineSettings settings;
+    settings.udpHost = "127.0.0.1";
+    settings.udpPort = kPort;
+    const auto& res = kResolutions[0];
+    CellPipeline pipeline = MakeBenchPipeline(
+        res, settings,
+        nt::NetworkTableInstance::GetDefault().GetTable("VisionBench/udp"));
+    cv::Mat bgr = MakeBgrFrame(res);
+
+    FrameInfo frame;
+    auto next = std::chrono::steady_clock::now();
+    for (int i = 0; i < kFrames; ++i) {
+      std::this_thread::sleep_until(next += kFramePeriod);
+      frame.captureTime = frame.grabTime = wpi::Now();
+      ++frame.sequence;
+      pipeline.Process(bgr, frame);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    done = true;
+    receiveThread.join();
+
+    std::sort(sendToReceiveMs.begin(), sendToReceiveMs.end());
+    std::sort(captureToReceiveMs.begin(), captureToReceiveMs.end());
+    std::printf("%-18s %10s %10s %10s\n", "", "p50 ms", "p99 ms", "max ms");
+    auto print = [](const char* name, const std::vector<double>& sorted) {
+      std::printf("%-18s %10.3f %10.3f %10.3f\n", name,
+                  Percentile(sorted, 0.50), Percentile(sorted, 0.99),
+                  sorted.empty() ? 0.0 : sorted.back());
+    };
+    print("send to receive", sendToReceiveMs);
+    print("capture to receive", captureToReceiveMs);
+    uint64_t received = receiver.GetReceived();
+    std::printf("received %llu of %d, %llu lost, %llu discarded\n",
+                static_cast<unsigned long long>(received), kFrames,
+                static_cast<unsigned long long>(receiver.GetLost()),
+                static_cast<unsigned long long>(receiver.GetDiscarded()));
+
+    // Loopback should lose nothing and deliver well within a frame
+    bool ok = received == kFrames && receiver.GetLost() == 0 &&
+              lastCount == kCellCount &&
+              Percentile(sendToReceiveMs, 0.99) < 5.0;
+    if (!ok) {
+      wpi::errs() << "datagrams were lost, late or wrong on loopback\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Stands in for a pipeline that takes a fixed time per frame.
+  struct SleepPipeline {
+    std::chrono::milliseconds work;
+    void Process(cv::Mat&) { std::this_thread::sleep_for(work); }
+  };
+
+  // Three PipelineRunners share one processing slot: a slow and a fast one
+  // whose cameras deliver 100 frames per second, and an idle one whose camera
+  // delivers none. The fast runner has to get a turn after every slow frame,
+  // and the idle one must never hold the slot while it waits.
+  int BenchScheduler() {
+    constexpr auto kSlowWork = std::chrono::milliseconds(40);
+    constexpr auto kFastWork = std::chrono::milliseconds(2);
+    constexpr auto kFramePeriod = std::chrono::milliseconds(10);
+    constexpr auto kDuration = std::chrono::seconds(3);
+    using Runner = PipelineRunner<SleepPipeline>;
+    const auto& res = kResolutions[0];
+
+    auto scheduler = std::make_shared<ProcessingScheduler>(1);
+    auto makeSource = [&](const char* name) {
+      return cs::CvSource(name, cs::VideoMode::kBGR, res.width, res.height,
+                          100);
+    };
+    cs::CvSource slowSource = makeSource("slow");
+    cs::CvSource fastSource = makeSource("fast");
+    cs::CvSource idleSource = makeSource("idle");
+    Runner slow(slowSource, new SleepPipeline{kSlowWork},
+                [](SleepPipeline&) {});
+    Runner fast(fastSource, new SleepPipeline{kFastWork},
+                [](SleepPipeline&) {});
+    Runner idle(idleSource, new SleepPipeline{kFastWork},
+                [](SleepPipeline&) {});
+    Runner* runners[] = {&slow, &fast, &idle};
+
+    std::vector<std::thread> threads;
+    for (auto runner : runners) {
+      runner->SetScheduler(scheduler);
+      threads.emplace_back([runner] { runner->RunForever(); });
+    }
+    cv::Mat bgr = MakeBgrFrame(res);
+    auto start = std::chrono::steady_clock::now();
+    for (auto next = start; next < start + kDuration; next += kFramePeriod) {
+      std::this_thread::sleep_until(next);
+      slowSource.PutFrame(bgr);
+      fastSource.PutFrame(bgr);
+    }
+    double seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    uint64_t slowFrames = slow.GetFramesProcessed();
+    uint64_t fastFrames = fast.GetFramesProcessed();
+    for (auto runner : runners) runner->Stop();
+    for (auto& thread : threads) thread.join();
+
+    std::printf("%-5s %12s %12s\n", "", "processed", "fps");
+    std::printf("%-5s %12llu %12.1f\n", "slow",
+                static_cast<unsigned long long>(slowFrames),
+                slowFrames / seconds);
+    std::printf("%-5s %12llu %12.1f\n", "fast",
+                static_cast<unsigned long long>(fastFrames),
+                fastFrames / seconds);
+    std::printf("%-5s %12llu\n", "idle",
+                static_cast<unsigned long long>(idle.GetFramesProcessed()));
+
+    // At worst the fast runner waits out one slow frame per frame of its own
+    double minFastFps =
+        0.8 / std::chrono::duration<double>(kSlowWork + kFastWork).count();
+    if (fastFrames / seconds < minFastFps) {
+      wpi::errs() << "the fast runner was starved: under " << minFastFps
+                  << " fps\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Projects balls at known positions through a distorted calibration with
+  // cv::projectPoints and reads their angles and distances back with
+  // CameraModel, with and without removing the distortion.
+  int BenchCamera() {
+    constexpr double kBallRadius = 3.5;
+    CameraIntrinsics calibration = MakeBenchCameraModel();
+    CameraIntrinsics pinhole = calibration;
+    pinhole.distortion.clear();
+
+    // Served at half the calibrated resolution
+    const cv::Size frameSize(320, 240);
+    CameraModel corrected(calibration);
+    CameraModel uncorrected(pinhole);
+    corrected.SetFrameSize(frameSize);
+    uncorrected.SetFrameSize(frameSize);
+
+    struct Ball {
+      double horizontal, vertical, distance;
+      cv::Point2f center;
+      double radius;
+    };
+    std::vector<Ball> balls;
+    for (int az = -25; az <= 25; az += 5) {
+      for (int el = -15; el <= 15; el += 5) {
+        for (int d = 40; d <= 200; d += 40) {
+          double h = az * CV_PI / 180.0, v = el * CV_PI / 180.0;
+          cv::Vec3d dir(-std::sin(h) * std::cos(v), -std::sin(v),
+                        std::cos(h) * std::cos(v));
+          // The ray grazing the ball, turned from the center toward +x
+          cv::Vec3d x(1.0, 0.0, 0.0);
+          cv::Vec3d t = cv::normalize(x - x.dot(dir) * dir);
+          double half = std::asin(kBallRadius / d);
+          std::vector<cv::Point3d> points = {
+              d * dir, d * (std::cos(half) * dir + std::sin(half) * t)};
+          std::vector<cv::Point2d> pixels;
+          cv::projectPoints(points, cv::Vec3d(), cv::Vec3d(),
+                            corrected.GetCameraMatrix(),
+                            corrected.GetDistortion(), pixels);
+          balls.push_back({static_cast<double>(az), static_cast<double>(el),
+                           static_cast<double>(d), cv::Point2f(pixels[0]),
+                           cv::norm(pixels[1] - pixels[0])});
+        }
+      }
+    }
+
+    std::printf("%-12s %14s %16s %12s\n", "model", "max angle err",
+                "max distance err", "us/target");
+    bool ok = true;
+    for (const auto* model : {&corrected, &uncorrected}) {
+      double angleError = 0.0, distanceError = 0.0;
+      for (const Ball& ball : balls) {
+        double h, v;
+        CameraModel::Angles(model->Normalize(ball.center), h, v);
+        double d =
+            model->SphereDistance(ball.center, ball.radius, kBallRadius);
+        angleError = std::max({angleError, std::abs(h - ball.horizontal),
+                               std::abs(v - ball.vertical)});
+        distanceError = std::max(distanceError,
+                                 std::abs(d - ball.distance) / ball.distance);
+      }
+      double us = TimeUs([&] {
+        for (const Ball& ball : balls) {
+          double h, v;
+          CameraModel::Angles(model->Normalize(ball.center), h, v);
+          model->SphereDistance(ball.center, ball.radius, kBallRadius);
+        }
+      }) / balls.size();
+      std::printf("%-12s %12.4f deg %15.2f%% %12.2f\n",
+                  model == &corrected ? "undistorted" : "pinhole only",
+                  angleError, 100.0 * distanceError, us);
+      if (model == &corrected) {
+        ok = angleError < 0.01 && distanceError < 0.005;
+      }
+    }
+    if (!ok) {
+      wpi::errs() << "CameraModel does not invert the projection\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Angle table lookups vs. undistorting and trig per point, for the cells'
+  // centers: cost per lookup, table build time and the worst difference over
+  // every half pixel of the frame.
+  int BenchAngles() {
+    CameraIntrinsics calibration = MakeBenchCameraModel();
+
+    std::printf("%-9s %-11s %10s %10s %10s %10s %12s\n", "size", "model",
+                "build ms", "table KB", "trig ns", "table ns", "max err deg");
+    bool ok = true;
+    for (const auto& res : kResolutions) {
+      for (bool distorted : {false, true}) {
+        CameraModel model(distorted ? calibration : CameraIntrinsics{});
+        auto start = std::chrono::steady_clock::now();
+        model.SetFrameSize({res.width, res.height});
+        double buildMs = std::chrono::duration<double, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+        double maxError = 0.0;
+        for (float y = 0; y <= res.height - 1; y += 0.5f) {
+          for (float x = 0; x <= res.width - 1; x += 0.5f) {
+            double h, v, hExact, vExact;
+            model.PixelAngles({x, y}, h, v);
+            model.PixelAnglesExact({x, y}, hExact, vExact);
+            maxError = std::max(
+                {maxError, std::abs(h - hExact), std::abs(v - vExact)});
+          }
+        }
+
+        // As many lookups as a frame full of targets would need
+        cv::RNG rng(1);
+        std::vector<cv::Point2f> centers(64);
+        for (auto& center : centers) {
+          center = cv::Point2f(rng.uniform(0.0f, res.width - 1.0f),
+                               rng.uniform(0.0f, res.height - 1.0f));
+        }
+        double h, v;
+        double trigNs = TimeUs([&] {
+          for (const auto& center : centers) {
+            model.PixelAnglesExact(center, h, v);
+          }
+        }) * 1000.0 / centers.size();
+        double tableNs = TimeUs([&] {
+          for (const auto& center : centers) model.PixelAngles(center, h, v);
+        }) * 1000.0 / centers.size();
+
+        char size[16];
+        std::snprintf(size, sizeof(size), "%dx%d", res.width, res.height);
+        std::printf("%-9s %-11s %10.2f %10.1f %10.1f %10.1f %12.5f\n", size,
+                    distorted ? "calibrated" : "fov", buildMs,
+                    model.GetAngleTableBytes() / 1024.0, trigNs, tableNs,
+                    maxError);
+        // Well under the 0.1 to 0.2 degrees a pixel spans
+        ok = ok && maxError < 0.02;
+      }
+    }
+    if (!ok) {
+      wpi::errs() << "angle table strays from the exact angles\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Fits a cell's pose along a path toward the camera, from the radius
+  // estimate every frame (cold) and from the previous frame's fit (warm):
+  // time per fit and worst distance error, with the radius estimate for
+  // comparison. Then checks that fits over a budget of 0 are all dropped.
+  int BenchPose() {
+    constexpr double kBallRadius = 3.5;
+    CameraIntrinsics calibration = MakeBenchCameraModel();
+    CameraModel camera(calibration);
+    camera.SetFrameSize({320, 240});
+
+    // The ball's outline, traced a degree at a time: its leftmost, rightmost,
+    // top and bottom points, as CellPipeline takes them from the contour and
+    // PoseEstimator::CellModel() orders them, and its enclosing circle
+    struct Frame {
+      cv::Point2f limbs[4];
+      cv::Point2f center;
+      float radius;
+      double distance;
+    };
+    std::vector<Frame> frames(iterations);
+    std::vector<cv::Point3f> outline(360);
+    std::vector<cv::Point2f> pixels;
+    for (int i = 0; i < iterations; ++i) {
+      double s = static_cast<double>(i) / std::max(1, iterations - 1);
+      double h = (25.0 - 45.0 * s) * CV_PI / 180.0;
+      double v = (-15.0 + 25.0 * s) * CV_PI / 180.0;
+      double d = 200.0 - 160.0 * s;
+      cv::Vec3d dir(-std::sin(h) * std::cos(v), -std::sin(v),
+                    std::cos(h) * std::cos(v));
+      cv::Vec3d x(1.0, 0.0, 0.0);
+      cv::Vec3d tx = cv::normalize(x - x.dot(dir) * dir);
+      cv::Vec3d ty = dir.cross(tx);
+      double half = std::asin(kBallRadius / d);
+      for (size_t j = 0; j < outline.size(); ++j) {
+        double a = j * CV_PI / 180.0;
+        cv::Vec3d ray = std::cos(half) * dir +
+                        std::sin(half) * (std::cos(a) * tx + std::sin(a) * ty);
+        outline[j] = cv::Point3f(ray[0], ray[1], ray[2]);
+      }
+      cv::projectPoints(outline, cv::Vec3d(), cv::Vec3d(),
+                        camera.GetCameraMatrix(), camera.GetDistortion(),
+                        pixels);
+      Frame& frame = frames[i];
+      auto byX = [](cv::Point2f a, cv::Point2f b) { return a.x < b.x; };
+      auto byY = [](cv::Point2f a, cv::Point2f b) { return a.y < b.y; };
+      auto [left, right] =
+          std::minmax_element(pixels.begin(), pixels.end(), byX);
+      auto [top, bottom] =
+          std::minmax_element(pixels.begin(), pixels.end(), byY);
+      frame.limbs[0] = *left;
+      frame.limbs[1] = *right;
+      frame.limbs[2] = *top;
+      frame.limbs[3] = *bottom;
+      cv::minEnclosingCircle(pixels, frame.center, frame.radius);
+      frame.distance = d;
+    }
+
+    auto radiusGuess = [&](const Frame& frame) {
+      cv::Point2f ray = camera.Normalize(frame.center);
+      double d =
+          camera.SphereDistance(frame.center, frame.radius, kBallRadius);
+      return TargetPose{cv::Vec3d(),
+                        cv::normalize(cv::Vec3d(ray.x, ray.y, 1.0)) * d};
+    };
+
+    std::printf("%-8s %10s %10s %16s\n", "start", "us/fit", "fitted",
+                "max distance err");
+    double radiusError = 0.0;
+    for (const Frame& frame : frames) {
+      radiusError = std::max(
+          radiusError,
+          std::abs(cv::norm(radiusGuess(frame).translation) - frame.distance) /
+              frame.distance);
+    }
+    std::printf("%-8s %10s %10s %15.2f%%\n", "radius", "-", "-",
+                100.0 * radiusError);
+
+    bool ok = true;
+    for (bool warm : {false, true}) {
+      PoseEstimator estimator(PoseEstimator::CellModel(kBallRadius));
+      TargetPose pose = radiusGuess(frames[0]);
+      int fitted = 0;
+      double maxError = 0.0;
+      auto start = std::chrono::steady_clock::now();
+      for (const Frame& frame : frames) {
+        if (!warm) pose = radiusGuess(frame);
+        if (estimator.Solve(camera, frame.limbs, pose, HUGE_VAL, 2.0)) {
+          ++fitted;
+          maxError = std::max(
+              maxError, std::abs(cv::norm(pose.translation) - frame.distance) /
+                            frame.distance);
+        }
+      }
+      double us = std::chrono::duration<double, std::micro>(
+                      std::chrono::steady_clock::now() - start)
+                      .count() /
+                  frames.size();
+      std::printf("%-8s %10.1f %6d/%-3zu %15.2f%%\n", warm ? "warm" : "cold",
+                  us, fitted, frames.size(), 100.0 * maxError);
+      // No worse than the radius estimate, which is within 1% here
+      ok = ok && fitted == static_cast<int>(frames.size()) &&
+           maxError <= std::max(radiusError, 0.01);
+    }
+
+    // Nothing fits in no time; every fit must fall back
+    PoseEstimator estimator(PoseEstimator::CellModel(kBallRadius));
+    for (const Frame& frame : frames) {
+      TargetPose pose = radiusGuess(frame);
+      estimator.Solve(camera, frame.limbs, pose, 0.0, 2.0);
+    }
+    std::printf("budget 0: %llu of %llu fits dropped\n",
+                static_cast<unsigned long long>(estimator.GetOverBudget()),
+                static_cast<unsigned long long>(estimator.GetSolves()));
+    ok = ok && estimator.GetOverBudget() == estimator.GetSolves();
+
+    if (!ok) {
+      wpi::errs() << "pose fits missed the projected ball or the budget\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Cells on the carpet seen by a distorted camera mounted 20 in up, pitched
+  // down and turned left: their ground plane position against the truth,
+  // row table against exact, and the ground plane range against the radius
+  // range when the threshold trims a pixel off the radius.
+  int BenchGround() {
+    constexpr double kBallRadius = 3.5;
+    CameraIntrinsics calibration = MakeBenchCameraModel();
+    CameraModel camera(calibration);
+    camera.SetFrameSize({320, 240});
+    CameraMount mount;
+    mount.height = 20.0;
+    mount.pitch = -15.0;
+    mount.yaw = 10.0;
+    GroundPlane ground(mount, kBallRadius);
+    auto start = std::chrono::steady_clock::now();
+    ground.SetCamera(camera);
+    double buildMs = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+
+    // The camera's axes in the robot's frame (x forward, y left, z up)
+    double p = mount.pitch * CV_PI / 180.0, w = mount.yaw * CV_PI / 180.0;
+    cv::Vec3d forward(std::cos(p) * std::cos(w), std::cos(p) * std::sin(w),
+                      std::sin(p));
+    cv::Vec3d right(std::sin(w), -std::cos(w), 0.0);
+    cv::Vec3d down = forward.cross(right);
+
+    double positionError = 0.0, groundError = 0.0, radiusError = 0.0;
+    double groundUs = 0.0;
+    int seen = 0, located = 0;
+    for (int x = 24; x <= 240; x += 12) {
+      for (int y = -96; y <= 96; y += 12) {
+        cv::Vec3d v = cv::Vec3d(x, y, kBallRadius - mount.height);
+        cv::Vec3d center(right.dot(v), down.dot(v), forward.dot(v));
+        cv::Vec3d side = center + cv::normalize(cv::Vec3d(1.0, 0.0, 0.0).cross(
+                                      center).cross(center)) *
+                                      kBallRadius;
+        std::vector<cv::Point3d> points = {center, side};
+        std::vector<cv::Point2d> pixels;
+        cv::projectPoints(points, cv::Vec3d(), cv::Vec3d(),
+                          camera.GetCameraMatrix(), camera.GetDistortion(),
+                          pixels);
+        cv::Point2f pixel(pixels[0]);
+        if (pixel.x < 0 || pixel.y < 0 || pixel.x > 319 || pixel.y > 239) {
+          continue;
+        }
+        ++seen;
+
+        double distance = cv::norm(center);
+        double d, gx, gy;
+        cv::Point2f normalized = camera.Normalize(pixel);
+        if (!ground.Locate(normalized, d, gx, gy)) continue;
+        ++located;
+        positionError = std::max(positionError, std::hypot(gx - x, gy - y));
+        groundError = std::max(groundError, std::abs(d - distance) / distance);
+
+        // A pixel of the cell lost to the threshold; the center barely moves
+        double radius = cv::norm(pixels[1] - pixels[0]) - 1.0;
+        double r = camera.SphereDistance(pixel, radius, kBallRadius);
+        radiusError = std::max(radiusError, std::abs(r - distance) / distance);
+
+        groundUs += TimeUs([&] { ground.Locate(normalized, d, gx, gy); });
+      }
+    }
+
+    // Table against exact over every half pixel below the horizon
+    double tableError = 0.0;
+    for (float y = 0; y <= 239; y += 0.5f) {
+      for (float x = 0; x <= 319; x += 0.5f) {
+        cv::Point2f normalized = camera.Normalize(cv::Point2f(x, y));
+        double d, gx, gy, dExact, gxExact, gyExact;
+        if (ground.Locate(normalized, d, gx, gy) &&
+            ground.LocateExact(normalized, dExact, gxExact, gyExact)) {
+          tableError = std::max(tableError, std::abs(d - dExact) / dExact);
+        }
+      }
+    }
+
+    std::printf("row table: %.1f KB, built in %.3f ms, %.1f ns per lookup\n",
+                ground.GetTableBytes() / 1024.0, buildMs,
+                located > 0 ? groundUs * 1000.0 / located : 0.0);
+    std::printf("%d of %d cells in view located on the ground plane\n",
+                located, seen);
+    std::printf("%-28s %10.4f in\n", "max position error", positionError);
+    std::printf("%-28s %10.4f%%\n", "max table vs exact error",
+                100.0 * tableError);
+    std::printf("%-28s %10.4f%%\n", "max ground range error",
+                100.0 * groundError);
+    std::printf("%-28s %10.4f%%\n", "max radius range error, -1px",
+                100.0 * radiusError);
+
+    bool ok = located == seen && seen > 0 && positionError < 0.5 &&
+              tableError < 0.001 && groundError < radiusError;
+    if (!ok) {
+      wpi::errs() << "ground plane misplaced the cells on the carpet\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // Changes CellPipeline's settings through its "tuning" table while it runs
+  // and checks how soon each change takes effect, and that invalid values
+  // are put back.
+  int BenchTuning() {
+    auto instance = nt::NetworkTableInstance::Create();
+    auto table = instance.GetTable("VisionBench/tuning");
+    auto tuning = table->GetSubTable("tuning");
+    const auto& res = kResolutions[0];
+    CellPipeline pipeline = MakeBenchPipeline(res, {}, table);
+    cv::Mat bgr = MakeBgrFrame(res);
+    FrameInfo frame;
+
+    // Processes frames until done() holds; returns the time it took in ms,
+    // or -1 if it did not within a second
+    auto processUntil = [&](const std::function<bool()>& done) {
+      auto start = std::chrono::steady_clock::now();
+      auto deadline = start + std::chrono::seconds(1);
+      for (;;) {
+        ++frame.sequence;
+        pipeline.Process(bgr, frame);
+        if (done()) {
+          return std::chrono::duration<double, std::milli>(
+                     std::chrono::steady_clock::now() - start)
+              .count();
+        }
+        if (std::chrono::steady_clock::now() > deadline) return -1.0;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    };
+    auto cellCount = [&] {
+      auto cells = table->GetEntry("Cells").GetDoubleArray({});
+      return cells.size() > 1 ? static_cast<int>(cells[1]) : -1;
+    };
+
+    bool ok = processUntil([&] { return cellCount() == kCellCount; }) >= 0;
+    std::printf("%-40s %10s\n", "change", "ms");
+
+    // Hue bound below the cells' hue: nothing is found
+    tuning->GetEntry("hueHigh").SetDouble(10.0);
+    double hueMs = processUntil([&] { return cellCount() == 0; });
+    std::printf("%-40s %10.3f\n", "hueHigh 10, cells gone", hueMs);
+
+    tuning->GetEntry("hueHigh").SetDouble(50.0);
+    tuning->GetEntry("maxTargets").SetDouble(2.0);
+    double capMs = processUntil([&] { return cellCount() == 2; });
+    std::printf("%-40s %10.3f\n", "hueHigh 50 and maxTargets 2", capMs);
+
+    // Even median sizes are invalid; the entry goes back to the old value
+    tuning->GetEntry("blurSize").SetDouble(4.0);
+    // Once for the change, once for the value being put back
+    instance.WaitForEntryListenerQueue(1.0);
+    instance.WaitForEntryListenerQueue(1.0);
+    double blurSize = tuning->GetEntry("blurSize").GetDouble(0.0);
+    processUntil([] { return true; });
+    std::printf("%-40s %10s\n", "blurSize 4 rejected",
+                blurSize == 7.0 && pipeline.GetSettings().blurSize == 7
+                    ? "yes"
+                    : "no");
+
+    ok = ok && hueMs >= 0 && capMs >= 0 && blurSize == 7.0 &&
+         pipeline.GetSettings().blurSize == 7;
+    if (!ok) {
+      wpi::errs() << "tuning changes were not applied as expected\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  // CellPipeline with the default settings, whose medianBlur and friends
+  // create scratch Mats every frame, on frames that switch resolution every
+  // few frames. Compares OpenCV's allocator with MatPool; report only.
+  int BenchMatPool() {
+    constexpr int kSwitchEvery = 10;
+    std::vector<cv::Mat> frames;
+    for (const auto& res : kResolutions) frames.push_back(MakeBgrFrame(res));
+
+    struct Allocator {
+      const char* name;
+      cv::MatAllocator* allocator;
+    };
+    const Allocator allocators[] = {{"opencv", cv::Mat::getStdAllocator()},
+                                    {"matpool", &MatPool::Instance()}};
+
+    std::printf("%-9s %12s %16s\n", "allocator", "ms/frame", "mallocs/frame");
+    for (const auto& a : allocators) {
+      cv::Mat::setDefaultAllocator(a.allocator);
+      CellPipeline pipeline = MakeBenchPipeline(kResolutions[0]);
+      FrameInfo frame;
+      frame.pixelFormat = cs::VideoMode::kBGR;
+      auto run = [&](int i) {
+        ++frame.sequence;
+        pipeline.Detect(frames[i / kSwitchEvery % frames.size()], frame);
+        pipeline.Draw();
+      };
+      for (int i = 0; i < 2 * kSwitchEvery * static_cast<int>(frames.size());
+           ++i) {
+        run(i);
+      }
+
+      tAllocations = 0;
+      tCountAllocations = true;
+      auto start = std::chrono::steady_clock::now();
+      for (int i = 0; i < iterations; ++i) run(i);
+      auto elapsed = std::chrono::steady_clock::now() - start;
+      tCountAllocations = false;
+      std::printf(
+          "%-9s %12.3f %16.1f\n", a.name,
+          std::chrono::duration<double, std::milli>(elapsed).count() /
+              iterations,
+          static_cast<double>(tAllocations) / iterations);
+    }
+    cv::Mat::setDefaultAllocator(cv::Mat::getStdAllocator());
+
+    auto stats = MatPool::Instance().GetStats();
+    std::printf(
+        "matpool: %llu hits, %llu misses, peak %.1f MB, idle %.1f MB\n",
+        static_cast<unsigned long long>(stats.hits),
+        static_cast<unsigned long long>(stats.misses),
+        stats.peakBytes / (1024.0 * 1024.0),
+        stats.idleBytes / (1024.0 * 1024.0));
+    return EXIT_SUCCESS;
+  }
+
+  // Pipelines that "replay" can run, built from a camera's "vision" config.
+  struct PipelineEntry {
+    const char* name;
+    std::unique_ptr<TimedVisionPipeline> (*make)(const wpi::json& vision);
+  };
+
+  std::unique_ptr<TimedVisionPipeline> MakeCellPipeline(
+      const wpi::json& vision) {
+    CellPipelineSettings settings;
+    ReadCellPipelineSettings(vision, settings, []() -> wpi::raw_ostream& {
+      return wpi::errs() << "vision config: ";
+    });
+    return std::make_unique<CellPipeline>(
+        cs::CvSource("replay", cs::VideoMode::kBGR, 640, 480, 30),
+        nt::NetworkTableInstance::GetDefault().GetTable("VisionBench"),
+        settings);
+  }
+
+  const PipelineEntry kPipelines[] = {
+      {"cell", MakeCellPipeline},
+  };
+
+  // Frames from a directory of images (in name order) or a video file.
+  class FrameSource {
+   public:
+    bool Open(const std::string& path) {
+      m_files.clear();
+      m_next = 0;
+      struct stat info;
+      if (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+        std::vector<cv::String> files;
+        cv::glob(path + "/*", files, false);
+        m_files.assign(files.begin(), files.end());
+        std::sort(m_files.begin(), m_files.end());
+        return !m_files.empty();
+      }
+      return m_video.open(path);
+    }
+
+    // Next frame as BGR; false at the end.
+    bool Read(cv::Mat& frame) {
+      if (m_video.isOpened()) return m_video.read(frame);
+      while (m_next < m_files.size()) {
+        // skip anything imread does not understand
+        frame = cv::imread(m_files[m_next++], cv::IMREAD_COLOR);
+        if (!frame.empty()) return true;
+      }
+      return false;
+    }
+
+   private:
+    std::vector<std::string> m_files;
+    size_t m_next = 0;
+    cv::VideoCapture m_video;
+  };
+
+  int Replay(int argc, char* argv[]) {
+    if (argc < 4) {
+      wpi::errs() << "usage: VisionBench replay <pipeline> <image dir or video>"
+                     " [--config <vision.json>] [--passes <n>]\n";
+      return EXIT_FAILURE;
+    }
+    const PipelineEntry* entry = nullptr;
+    for (const auto& pipeline : kPipelines) {
+      if (std::strcmp(argv[2], pipeline.name) == 0) entry = &pipeline;
+    }
+    if (!entry) {
+      wpi::errs() << "unknown pipeline '" << argv[2] << "'; known:";
+      for (const auto& pipeline : kPipelines) wpi::errs() << ' ' << pipeline.name;
+      wpi::errs() << '\n';
+      return EXIT_FAILURE;
+    }
+    std::string source = argv[3];
+
+    // The "vision" object of a camera in /boot/frc.json, or a file holding
+    // just that object
+    wpi::json vision = wpi::json::object();
+    int passes = 1;
+    for (int i = 4; i + 1 < argc; i += 2) {
+      if (std::strcmp(argv[i], "--passes") == 0) {
+        passes = std::max(1, std::atoi(argv[i + 1]));
+      } else if (std::strcmp(argv[i], "--config") == 0) {
+        std::error_code ec;
+        wpi::raw_fd_istream is(argv[i + 1], ec);
+        if (ec) {
+          wpi::errs() << "could not open '" << argv[i + 1]
+                      << "': " << ec.message() << '\n';
+          return EXIT_FAILURE;
+        }
+        try {
+          vision = wpi::json::parse(is);
+        } catch (const wpi::json::parse_error& e) {
+          wpi::errs() << argv[i + 1] << ": byte " << e.byte << ": " << e.what()
+                      << '\n';
+          return EXIT_FAILURE;
+        }
+        if (vision.count("vision") != 0) vision = vision.at("vision");
+      } else {
+        wpi::errs() << "unknown option '" << argv[i] << "'\n";
+        return EXIT_FAILURE;
+      }
+    }
+
+    auto pipeline = entry->make(vision);
+    std::vector<double> frameMs;
+    cv::Mat image;
+    FrameInfo frame;
+    int width = 0, height = 0;
+    auto wallStart = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; ++pass) {
+      FrameSource frames;
+      if (!frames.Open(source)) {
+        wpi::errs() << "no images or video at '" << source << "'\n";
+        return EXIT_FAILURE;
+      }
+      // Only Process() is timed; decoding the input is not
+      while (frames.Read(image)) {
+        width = image.cols;
+        height = image.rows;
+        frame.captureTime = wpi::Now();
+        ++frame.sequence;
+        auto start = std::chrono::steady_clock::now();
+        pipeline->Process(image, frame);
+        frameMs.push_back(std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+      }
+    }
+    double wallSeconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - wallStart)
+                             .count();
+
+    double processMs = 0.0;
+    for (double ms : frameMs) processMs += ms;
+    std::vector<double> sorted = frameMs;
+    std::sort(sorted.begin(), sorted.end());
+
+    wpi::json result;
+    result["pipeline"] = entry->name;
+    result["source"] = source;
+    result["passes"] = passes;
+    result["frames"] = frameMs.size();
+    result["width"] = width;
+    result["height"] = height;
+    result["throughput_fps"] =
+        processMs > 0.0 ? frameMs.size() / (processMs / 1000.0) : 0.0;
+    result["wall_fps"] = wallSeconds > 0.0 ? frameMs.size() / wallSeconds : 0.0;
+    result["latency_ms"] = {
+        {"mean", frameMs.empty() ? 0.0 : processMs / frameMs.size()},
+        {"p50", Percentile(sorted, 0.50)},
+        {"p99", Percentile(sorted, 0.99)},
+        {"max", sorted.empty() ? 0.0 : sorted.back()}};
+
+    // Stage percentiles cover the last DurationHistogram::kWindow frames
+    wpi::json stages = wpi::json::array();
+    for (const auto& stage : pipeline->GetStageSummary()) {
+      stages.push_back({{"name", stage.name},
+                        {"mean_ms", stage.meanMs},
+                        {"p50_ms", stage.p50Ms},
+                        {"p95_ms", stage.p95Ms},
+                        {"max_ms", stage.maxMs}});
+    }
+    result["stage_window_frames"] = DurationHistogram::kWindow;
+    result["stages"] = stages;
+
+    wpi::outs() << result.dump(2) << '\n';
+    return frameMs.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+  }
+
+  // Contours and polygons CompareContours() has checked, how many differed
+  // from OpenCV's, and the finder and approximator under test.
+  struct ContourCheck {
+    ContourFinder finder;
+    PolygonApproximator approximator;
+    PolygonPool approximated;
+    long long masks = 0;
+    long long contours = 0;
+    long long polygons = 0;
+    long long mismatches = 0;
+  };
+
+  // Checks ContourFinder against cv::findContours (CHAIN_APPROX_SIMPLE) in
+  // both modes, and PolygonApproximator against cv::approxPolyDP on every
+  // contour OpenCV finds. Points must match exactly and in order.
+  void CompareContours(const cv::Mat& mask, const char* name,
+                       ContourCheck& check) {
+    struct Mode {
+      ContourFinder::Mode finder;
+      int opencv;
+      const char* name;
+    };
+    const Mode kModes[] = {
+        {ContourFinder::Mode::kExternal, cv::RETR_EXTERNAL, "external"},
+        {ContourFinder::Mode::kTree, cv::RETR_TREE, "tree"}};
+    // 3 is what CellPipeline uses
+    const double kEpsilons[] = {0.5, 1.0, 3.0, 8.0};
+    // CellPipeline offsets contours found in a search window
+    const cv::Point kOffset{5, 7};
+
+    ContourFinder& finder = check.finder;
+    PolygonApproximator& approximator = check.approximator;
+    PolygonPool& polygons = check.approximated;
+    std::vector<std::vector<cv::Point>> expected;
+    std::vector<cv::Point> expectedPolygon;
+
+    ++check.masks;
+    for (const auto& mode : kModes) {
+      cv::findContours(mask, expected, mode.opencv, cv::CHAIN_APPROX_SIMPLE,
+                       kOffset);
+      finder.Clear();
+      finder.Find(mask, mode.finder, kOffset);
+      const PolygonPool& found = finder.Contours();
+      check.contours += expected.size();
+
+      bool same = found.Size() == static_cast<int>(expected.size());
+      for (int i = 0; same && i < found.Size(); ++i) {
+        same = found.Count(i) == static_cast<int>(expected[i].size()) &&
+               std::equal(expected[i].begin(), expected[i].end(),
+                          found.Points(i));
+      }
+      if (!same) {
+        ++check.mismatches;
+        std::printf("%s %dx%d %s: %d contours, OpenCV %zu, differ\n", name,
+                    mask.cols, mask.rows, mode.name, found.Size(),
+                    expected.size());
+        continue;
+      }
+
+      for (int i = 0; i < found.Size(); ++i) {
+        for (double epsilon : kEpsilons) {
+          cv::approxPolyDP(expected[i], expectedPolygon, epsilon, true);
+          polygons.Clear();
+          approximator.Approximate(found.Points(i), found.Count(i), epsilon,
+                                   polygons);
+          ++check.polygons;
+          if (polygons.Count(0) != static_cast<int>(expectedPolygon.size()) ||
+              !std::equal(expectedPolygon.begin(), expectedPolygon.end(),
+                          polygons.Points(0))) {
+            ++check.mismatches;
+            std::printf(
+                "%s %dx%d %s contour %d, epsilon %.1f: %d vertices, "
+                "OpenCV %zu, differ\n",
+                name, mask.cols, mask.rows, mode.name, i, epsilon,
+                polygons.Count(0), expectedPolygon.size());
+          }
+        }
+      }
+    }
+  }
+
+  int BenchContours() {
+    ColorThresholdParams params;
+    cv::Mat gammaTable = MakeGammaTable(params.gamma);
+    cv::Mat gammaScratch, hsv, mask, blurred;
+    ContourCheck check;
+
+    // The synthetic camera frames, thresholded and denoised as CellPipeline
+    // does by default, and timed both ways
+    std::printf("%-9s %16s %16s\n", "size", "findContours us",
+                "ContourFinder us");
+    for (const auto& res : kResolutions) {
+      ThresholdBgr(MakeBgrFrame(res), gammaTable, params, gammaScratch, hsv,
+                   mask);
+      cv::medianBlur(mask, blurred, 7);
+      CompareContours(MakeCellMask(res), "cells", check);
+      CompareContours(mask, "threshold", check);
+      CompareContours(blurred, "median", check);
+
+      std::vector<std::vector<cv::Point>> contours;
+      ContourFinder finder;
+      double opencvUs = TimeUs([&] {
+        cv::findContours(blurred, contours, cv::RETR_TREE,
+                         cv::CHAIN_APPROX_SIMPLE);
+      });
+      double finderUs = TimeUs([&] {
+        finder.Clear();
+        finder.Find(blurred, ContourFinder::Mode::kTree);
+      });
+      char size[16];
+      std::snprintf(size, sizeof(size), "%dx%d", res.width, res.height);
+      std::printf("%-9s %16.1f %16.1f\n", size, opencvUs, finderUs);
+    }
+
+    // Blobs with holes, islands and one-pixel necks, on masks of every shape
+    // down to a single row or column, touching the image edges
+    cv::RNG rng(0x5eed);
+    cv::Mat noise;
+    for (int i = 0; i < iterations; ++i) {
+      int rows = rng.uniform(1, 97);
+      int cols = rng.uniform(1, 97);
+      noise.create(rows, cols, CV_8U);
+      rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+      double sigma = rng.uniform(0.0, 3.0);
+      if (sigma > 0.5) cv::GaussianBlur(noise, noise, {0, 0}, sigma);
+      cv::threshold(noise, mask, rng.uniform(32, 224), 255, cv::THRESH_BINARY);
+      CompareContours(mask, "random", check);
+    }
+    CompareContours(cv::Mat(48, 64, CV_8U, cv::Scalar(255)), "full", check);
+    CompareContours(cv::Mat::zeros(48, 64, CV_8U), "empty", check);
+
+    // Recorded frames, when given
+    if (benchInput) {
+      FrameSource frames;
+      if (!frames.Open(benchInput)) {
+        wpi::errs() << "no images or video at '" << benchInput << "'\n";
+        return EXIT_FAILURE;
+      }
+      cv::Mat image;
+      while (frames.Read(image)) {
+        ThresholdBgr(image, gammaTable, params, gammaScratch, hsv, mask);
+        cv::medianBlur(mask, blurred, 7);
+        CompareContours(mask, "replay threshold", check);
+        CompareContours(blurred, "replay median", check);
+      }
+    }
+
+    std::printf("%lld masks, %lld contours, %lld polygons, %lld differ\n",
+                check.masks, check.contours, check.polygons, check.mismatches);
+    if (check.mismatches != 0) {
+      wpi::errs() << "ContourFinder or PolygonApproximator does not match "
+                     "OpenCV\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  struct Benchmark {
+    const char* name;
+    const char* description;
+    int (*run)();
+  };
+
+  const Benchmark kBenchmarks[] = {
+      {"yuyv", "YUYV threshold table vs. BGR/HSV chain", BenchYuyv},
+      {"fused", "fused gamma/HSV/inRange kernel vs. the chain", BenchFused},
+      {"lut", "BGR bit table lookup vs. the chain", BenchLut},
+      {"denoise", "denoise strategies: speed and accuracy", BenchDenoise},
+      {"latency", "capture-to-NT latency checked on loopback", BenchLatency},
+      {"udp", "binary target datagrams: latency and loss on loopback",
+       BenchUdp},
+      {"scheduler", "shared processing slots: a slow runner vs. a fast one",
+       BenchScheduler},
+      {"pyramid", "CellPipeline coarse-to-fine vs. full resolution",
+       BenchPyramid},
+      {"alloc", "heap allocations per steady-state CellPipeline frame",
+       BenchAlloc},
+      {"matpool", "MatPool vs. OpenCV's allocator across resolution changes",
+       BenchMatPool},
+      {"tuning", "live CellPipeline tuning over NetworkTables", BenchTuning},
+      {"camera", "CameraModel angles and distances vs. projected truth",
+       BenchCamera},
+      {"angles", "pixel-to-angle table vs. undistort and trig per point",
+       BenchAngles},
+      {"pose", "solvePnP cell poses: warm vs. cold start, and the budget",
+       BenchPose},
+      {"ground", "ground plane cell positions vs. truth and the radius",
+       BenchGround},
+      {"contours", "ContourFinder and approxPolyDP port vs. OpenCV, exact",
+       BenchContours},
+  };
+
+  void PrintUsage() {
+    wpi::errs() << "usage: VisionBench <benchmark> [iterations]"
+                   " [image dir or video]\n";
+    for (const auto& bench : kBenchmarks)
+      wpi::errs() << "  " << bench.name << "\t" << bench.description << '\n';
+    wpi::errs() << "   or: VisionBench replay <pipeline> <image dir or video>"
+                   " [--config <vision.json>] [--passes <n>]\n";
+  }
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    PrintUsage();
+    return EXIT_FAILURE;
+  }
+  if (std::strcmp(argv[1], "replay") == 0) return Replay(argc, argv);
+  if (argc >= 3) iterations = std::max(1, std::atoi(argv[2]));
+  if (argc >= 4) benchInput = argv[3];
+
+  for (const auto& bench : kBenchmarks) {
+    if (std::strcmp(argv[1], bench.name) == 0) return bench.run();
+  }
+  PrintUsage();
+  return EXIT_FAILURE;
+}
+
+// Counting versions of the glibc allocation functions; the __libc_ entry
+// points are glibc's own implementations.
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size) noexcept {
+  if (tCountAllocations) ++tAllocations;
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) noexcept {
+  if (tCountAllocations) ++tAllocations;
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) noexcept {
+  if (tCountAllocations) ++tAllocations;
+  return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) noexcept {
+  if (tCountAllocations) ++tAllocations;
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) noexcept {
+  return memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) noexcept {
+  void* p = memalign(alignment, size);
+  if (!p) return ENOMEM;
+  *ptr = p;
+  return 0;
+}
+}
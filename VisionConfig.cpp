@@ -0,0 +1,271 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#include "VisionConfig.h"
+
+#include <cmath>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace dragonvision;
+
+namespace {
+
+using ThresholdMethod = CellPipelineSettings::ThresholdMethod;
+using DenoiseMethod = CellPipelineSettings::DenoiseMethod;
+using RankBy = CellPipelineSettings::RankBy;
+
+template <typename T>
+struct Choice {
+  const char* name;
+  T value;
+};
+
+constexpr Choice<ThresholdMethod> kThresholdMethods[] = {
+    {"chain", ThresholdMethod::kChain},
+    {"fused", ThresholdMethod::kFused},
+    {"lut", ThresholdMethod::kLut}};
+
+constexpr Choice<DenoiseMethod> kDenoiseMethods[] = {
+    {"hsv median", DenoiseMethod::kHsvMedian},
+    {"hsv box", DenoiseMethod::kHsvBox},
+    {"mask median", DenoiseMethod::kMaskMedian},
+    {"mask majority", DenoiseMethod::kMaskMajority},
+    {"none", DenoiseMethod::kNone}};
+
+constexpr Choice<RankBy> kRankBy[] = {{"size", RankBy::kSize},
+                                      {"distance", RankBy::kDistance},
+                                      {"center offset", RankBy::kCenterOffset}};
+
+template <typename T, size_t N>
+bool Parse(const Choice<T> (&choices)[N], wpi::StringRef name, T& value) {
+  for (const auto& choice : choices) {
+    if (name == choice.name) {
+      value = choice.value;
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename T, size_t N>
+const char* Name(const Choice<T> (&choices)[N], T value) {
+  for (const auto& choice : choices) {
+    if (value == choice.value) return choice.name;
+  }
+  return "";
+}
+
+// Reads an optional [h, s, v] bound into bound
+void ReadHsvBound(const wpi::json& vision, const char* key, cv::Scalar& bound,
+                  const ConfigError& error) {
+  std::vector<double> hsv;
+  ReadSetting(vision, key, hsv, error);
+  if (hsv.empty()) return;
+  if (hsv.size() != 3) {
+    error() << key << " must be [h, s, v]\n";
+    return;
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (hsv[i] < 0.0 || hsv[i] > kHsvMax[i]) {
+      error() << key << " must be within [0, 0, 0] to [180, 255, 255]\n";
+      return;
+    }
+  }
+  bound = cv::Scalar(hsv[0], hsv[1], hsv[2]);
+}
+
+// Reads a "camera model" object; an incomplete calibration is reported and
+// dropped in favor of the field of view
+void ReadCameraIntrinsics(const wpi::json& model, CameraIntrinsics& camera,
+                          const ConfigError& error) {
+  ReadSetting(model, "horizontal fov", camera.horizontalFov, error);
+  if (camera.horizontalFov <= 0.0 || camera.horizontalFov >= 180.0) {
+    error() << "horizontal fov must be between 0 and 180 degrees\n";
+    camera.horizontalFov = CameraIntrinsics{}.horizontalFov;
+  }
+
+  CameraIntrinsics calibration;
+  ReadSetting(model, "width", calibration.size.width, error);
+  ReadSetting(model, "height", calibration.size.height, error);
+  ReadSetting(model, "fx", calibration.fx, error);
+  ReadSetting(model, "fy", calibration.fy, error);
+  ReadSetting(model, "cx", calibration.cx, error);
+  ReadSetting(model, "cy", calibration.cy, error);
+  ReadSetting(model, "distortion", calibration.distortion, error);
+  bool any = model.count("width") || model.count("height") ||
+             model.count("fx") || model.count("fy") || model.count("cx") ||
+             model.count("cy") || model.count("distortion");
+  if (!any) return;
+  if (!calibration.IsCalibrated() || !model.count("cx") ||
+      !model.count("cy")) {
+    error() << "camera model needs positive width, height, fx and fy, and "
+               "cx and cy; using the horizontal fov\n";
+    return;
+  }
+  if (!calibration.IsValidDistortion()) {
+    error() << "camera model distortion must have 4, 5, 8, 12 or 14 "
+               "coefficients; using none\n";
+    calibration.distortion.clear();
+  }
+  calibration.horizontalFov = camera.horizontalFov;
+  camera = calibration;
+}
+
+void ReadCameraMount(const wpi::json& plane, CameraMount& mount,
+                     const ConfigError& error) {
+  CameraMount read;
+  ReadSetting(plane, "height", read.height, error);
+  ReadSetting(plane, "pitch", read.pitch, error);
+  ReadSetting(plane, "yaw", read.yaw, error);
+  if (!(read.height > 0.0)) {
+    error() << "ground plane needs a positive height; ignoring it\n";
+    return;
+  }
+  if (!(std::abs(read.pitch) < 90.0)) {
+    error() << "ground plane pitch must be between -90 and 90 degrees; "
+               "ignoring it\n";
+    return;
+  }
+  mount = read;
+}
+
+}  // namespace
+
+bool dragonvision::ParseThresholdMethod(wpi::StringRef name,
+                                        ThresholdMethod& value) {
+  return Parse(kThresholdMethods, name, value);
+}
+
+bool dragonvision::ParseDenoiseMethod(wpi::StringRef name,
+                                      DenoiseMethod& value) {
+  return Parse(kDenoiseMethods, name, value);
+}
+
+bool dragonvision::ParseRankBy(wpi::StringRef name, RankBy& value) {
+  return Parse(kRankBy, name, value);
+}
+
+const char* dragonvision::ThresholdMethodName(ThresholdMethod value) {
+  return Name(kThresholdMethods, value);
+}
+
+const char* dragonvision::DenoiseMethodName(DenoiseMethod value) {
+  return Name(kDenoiseMethods, value);
+}
+
+const char* dragonvision::RankByName(RankBy value) {
+  return Name(kRankBy, value);
+}
+
+void dragonvision::ReadCellPipelineSettings(const wpi::json& vision,
+                                            CellPipelineSettings& settings,
+                                            const ConfigError& error) {
+  ReadSetting(vision, "gamma", settings.color.gamma, error);
+  if (settings.color.gamma <= 0.0) {
+    error() << "gamma must be positive\n";
+    settings.color.gamma = ColorThresholdParams{}.gamma;
+  }
+  ReadHsvBound(vision, "hsv low", settings.color.hsvLow, error);
+  ReadHsvBound(vision, "hsv high", settings.color.hsvHigh, error);
+
+  std::string threshold = ThresholdMethodName(settings.threshold);
+  ReadSetting(vision, "threshold", threshold, error);
+  if (!ParseThresholdMethod(threshold, settings.threshold)) {
+    error() << "unknown threshold '" << threshold << "'\n";
+  }
+
+  std::string denoise = DenoiseMethodName(settings.denoise);
+  ReadSetting(vision, "denoise", denoise, error);
+  if (!ParseDenoiseMethod(denoise, settings.denoise)) {
+    error() << "unknown denoise '" << denoise << "'\n";
+  }
+
+  ReadSetting(vision, "blur size", settings.blurSize, error);
+  if (!CellPipelineSettings::IsValidKernelSize(settings.blurSize)) {
+    error() << "blur size must be odd, 1 to "
+            << CellPipelineSettings::kMaxKernelSize << '\n';
+    settings.blurSize = CellPipelineSettings{}.blurSize;
+  }
+  ReadSetting(vision, "opening size", settings.openingSize, error);
+  if (!CellPipelineSettings::IsValidKernelSize(settings.openingSize)) {
+    error() << "opening size must be odd, 1 to "
+            << CellPipelineSettings::kMaxKernelSize << '\n';
+    settings.openingSize = CellPipelineSettings{}.openingSize;
+  }
+  ReadSetting(vision, "max cell radius", settings.maxCellRadius, error);
+  if (settings.maxCellRadius <= 0.0) {
+    error() << "max cell radius must be positive\n";
+    settings.maxCellRadius = CellPipelineSettings{}.maxCellRadius;
+  }
+  if (vision.is_object() && vision.count("camera model") != 0) {
+    ReadCameraIntrinsics(vision.at("camera model"), settings.camera, error);
+  }
+  ReadSetting(vision, "angle table", settings.angleTable, error);
+  if (vision.is_object() && vision.count("ground plane") != 0) {
+    ReadCameraMount(vision.at("ground plane"), settings.mount, error);
+  }
+
+  ReadSetting(vision, "pose", settings.pose, error);
+  ReadSetting(vision, "pose budget us", settings.poseBudgetUs, error);
+  if (settings.poseBudgetUs < 0.0) {
+    error() << "pose budget us must not be negative\n";
+    settings.poseBudgetUs = CellPipelineSettings{}.poseBudgetUs;
+  }
+  ReadSetting(vision, "pose max error", settings.poseMaxError, error);
+  if (settings.poseMaxError < 0.0) {
+    error() << "pose max error must not be negative\n";
+    settings.poseMaxError = CellPipelineSettings{}.poseMaxError;
+  }
+
+  ReadSetting(vision, "lut bits", settings.lutBits, error);
+  if (settings.lutBits < BgrThresholdLut::kMinBitsPerChannel ||
+      settings.lutBits > 8) {
+    error() << "lut bits must be " << BgrThresholdLut::kMinBitsPerChannel
+            << " to 8\n";
+    settings.lutBits = BgrThresholdLut::kDefaultBitsPerChannel;
+  }
+
+  ReadSetting(vision, "roi tracking", settings.roiTracking, error);
+  ReadSetting(vision, "roi radius scale", settings.roiRadiusScale, error);
+  ReadSetting(vision, "roi motion", settings.roiMotion, error);
+  ReadSetting(vision, "roi full frame interval", settings.roiFullFrameInterval,
+              error);
+
+  ReadSetting(vision, "pyramid levels", settings.pyramidLevels, error);
+  if (settings.pyramidLevels < 0 ||
+      settings.pyramidLevels > CellPipelineSettings::kMaxPyramidLevels) {
+    error() << "pyramid levels must be 0 to "
+            << CellPipelineSettings::kMaxPyramidLevels << '\n';
+    settings.pyramidLevels = 0;
+  }
+
+  std::string rankBy = RankByName(settings.rankBy);
+  ReadSetting(vision, "rank by", rankBy, error);
+  if (!ParseRankBy(rankBy, settings.rankBy)) {
+    error() << "unknown rank by '" << rankBy << "'\n";
+  }
+
+  ReadSetting(vision, "max targets", settings.maxTargets, error);
+  if (settings.maxTargets < 0) {
+    error() << "max targets must not be negative\n";
+    settings.maxTargets = CellPipelineSettings{}.maxTargets;
+  }
+
+  ReadSetting(vision, "udp host", settings.udpHost, error);
+  ReadSetting(vision, "udp port", settings.udpPort, error);
+  if (settings.udpPort < 0 || settings.udpPort > 65535) {
+    error() << "udp port must be 0 to 65535\n";
+    settings.udpPort = 0;
+  } else if (settings.udpPort > 0 && settings.udpHost.empty()) {
+    error() << "udp port needs a udp host\n";
+    settings.udpPort = 0;
+  }
+
+  ReadSetting(vision, "perf rate", settings.perfRate, error);
+  ReadSetting(vision, "overlay fps", settings.overlayFps, error);
+  ReadSetting(vision, "latency", settings.latency, error);
+  ReadSetting(vision, "live tuning", settings.liveTuning, error);
+}
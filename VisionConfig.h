@@ -0,0 +1,66 @@
+// Copyright (c) FIRST and other WPILib contributors.
+// Open Source Software; you can modify and/or share it under the terms of
+// the WPILib BSD license file in the root directory of this project.
+
+#pragma once
+
+#include <functional>
+
+#include <wpi/StringRef.h>
+#include <wpi/json.h>
+#include <wpi/raw_ostream.h>
+
+#include "CellPipeline.h"
+
+namespace dragonvision {
+
+/**
+ * Returns the stream a config problem is written to, already prefixed with
+ * where the problem is (file, camera).
+ */
+using ConfigError = std::function<wpi::raw_ostream&()>;
+
+/**
+ * Reads an optional key of a JSON object; leaves value alone if absent or
+ * unreadable.
+ */
+template <typename T>
+void ReadSetting(const wpi::json& object, const char* key, T& value,
+                 const ConfigError& error) {
+  if (!object.is_object() || object.count(key) == 0) return;
+  try {
+    value = object.at(key).get<T>();
+  } catch (const wpi::json::exception& e) {
+    error() << "could not read " << key << ": " << e.what() << '\n';
+  }
+}
+
+/**
+ * Names of the CellPipelineSettings choices, as written in the config and in
+ * the tuning table. The Parse functions return false for an unknown name and
+ * leave value alone.
+ */
+bool ParseThresholdMethod(wpi::StringRef name,
+                          CellPipelineSettings::ThresholdMethod& value);
+bool ParseDenoiseMethod(wpi::StringRef name,
+                        CellPipelineSettings::DenoiseMethod& value);
+bool ParseRankBy(wpi::StringRef name, CellPipelineSettings::RankBy& value);
+const char* ThresholdMethodName(CellPipelineSettings::ThresholdMethod value);
+const char* DenoiseMethodName(CellPipelineSettings::DenoiseMethod value);
+const char* RankByName(CellPipelineSettings::RankBy value);
+
+/**
+ * Largest value of each HSV channel of an 8-bit OpenCV HSV image.
+ */
+constexpr double kHsvMax[3] = {180.0, 255.0, 255.0};
+
+/**
+ * Reads the CellPipeline keys of a camera's "vision" config object (see the
+ * format in main.cpp) into settings. Absent keys keep their current value;
+ * invalid ones are reported and fall back to the default.
+ */
+void ReadCellPipelineSettings(const wpi::json& vision,
+                              CellPipelineSettings& settings,
+                              const ConfigError& error);
+
+}  // namespace dragonvision
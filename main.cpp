@@ -2,6 +2,7 @@
 // Open Source Software; you can modify and/or share it under the terms of
 // the WPILib BSD license file in the root directory of this project.
 
+#include <algorithm>
 #include <cstdio>
 #include <string>
 #include <thread>
@@ -13,7 +14,6 @@
 
 #include <networktables/NetworkTableInstance.h>
 #include <vision/VisionPipeline.h>
-#include <vision/VisionRunner.h>
 #include <wpi/StringRef.h>
 #include <wpi/json.h>
 #include <wpi/raw_istream.h>
@@ -21,10 +21,16 @@
 //#include <pipeline/CellPipeline.h>
 
 #include "cameraserver/CameraServer.h"
+#include "CellPipeline.h"
+#include "CameraTelemetry.h"
+#include "MatPool.h"
+#include "PipelineRunner.h"
+#include "VisionConfig.h"
 
 #include <opencv/cv.hpp>
 
 using namespace cv;
+using dragonvision::CellPipeline;
 
 
 
@@ -34,6 +40,14 @@ using namespace cv;
    {
        "team": <team number>,
        "ntmode": <"client" or "server", "client" if unspecified>
+       "telemetry period": <seconds>  // camera/processed fps published this
+                                      // often (default 1, 0 off)
+       "mat pool": <true/false>       // pooled allocator for every cv::Mat,
+                                      // stats under <table>/perf/matpool
+                                      // (default true)
+       "cpu budget": <frames>         // most frames processed at once across
+                                      // all cameras (default one less than
+                                      // the cores, at least 1)
        "cameras": [
            {
                "name": <camera name>
@@ -58,6 +72,109 @@ using namespace cv;
                            "value": <stream property value>
                        }
                    ]
+               },
+               "vision": {                              // optional
+                   "pipeline": <"cell" or "none">       // default "cell" on the first
+                                                        // camera, "none" on the rest
+                   "table": <NetworkTables path>        // results and counters
+                                                        // (default "visionTable" on
+                                                        // the first camera with a
+                                                        // pipeline, else
+                                                        // "visionTable/<name>")
+                   "max fps": <frames per second>       // processing rate cap
+                                                        // (default 0, no cap)
+                   "async capture": <true/false>        // grab on its own thread
+                                                        // (default true)
+                   "frame format": <"bgr" or "native">  // "native" thresholds YUYV
+                                                        // without converting to BGR
+                                                        // (default "bgr")
+                   "gamma": <gamma>                     // gamma correction before the
+                                                        // HSV threshold (default 0.9)
+                   "hsv low": [<h>, <s>, <v>]           // HSV threshold bounds; h is
+                   "hsv high": [<h>, <s>, <v>]          // 0 to 180 (default [5, 125,
+                                                        // 50] to [50, 255, 255])
+                   "threshold": <"chain", "fused" or "lut">  // BGR thresholding
+                                                        // method (default "chain")
+                   "lut bits": <5 to 8>                 // "lut" bits per channel;
+                                                        // 8 is exact (default 8)
+                   "denoise": <"hsv median", "hsv box", "mask median",
+                               "mask majority" or "none">  // noise filter before the
+                                                        // opening (default "hsv median");
+                                                        // "fused" and "lut" use "mask
+                                                        // median" for the hsv modes, and
+                                                        // "native" frames convert to BGR
+                                                        // for them
+                   "blur size": <odd pixels>            // denoise window (default 7)
+                   "opening size": <odd pixels>         // opening of the mask (default
+                                                        // 1, none)
+                   "max cell radius": <pixels>          // larger candidates are not
+                                                        // cells (default 30)
+                   "camera model": {                    // optional; angles and
+                                                        // distances are measured
+                                                        // through it
+                       "horizontal fov": <degrees>      // of an ideal camera, used
+                                                        // without calibration
+                                                        // (default 60)
+                       "width": <pixels>                // resolution calibrated at
+                       "height": <pixels>
+                       "fx": <pixels>                   // camera matrix, as from
+                       "fy": <pixels>                   // cv::calibrateCamera
+                       "cx": <pixels>
+                       "cy": <pixels>
+                       "distortion": [<k1>, <k2>, <p1>, <p2>, <k3>]  // optional
+                   }
+                   "angle table": <true/false>          // look up angles per video
+                                                        // mode instead of computing
+                                                        // them per cell (default true)
+                   "ground plane": {                    // optional; cells on the
+                                                        // carpet are located by where
+                                                        // they are seen
+                       "height": <inches>               // lens above the carpet
+                       "pitch": <degrees>               // up from level (default 0)
+                       "yaw": <degrees>                 // left of the robot's forward
+                                                        // (default 0)
+                   }
+                   "pose": <true/false>                 // also fit each cell's pose
+                                                        // with solvePnP and publish
+                                                        // "CellPoses" (default false)
+                   "pose budget us": <microseconds>     // slower fits fall back to
+                                                        // the radius (default 500)
+                   "pose max error": <pixels>           // worse fits fall back too
+                                                        // (default 2)
+                   "roi tracking": <true/false>         // search near the last cell
+                                                        // (default false)
+                   "roi radius scale": <multiple>       // window half-size per cell
+                                                        // radius (default 2)
+                   "roi motion": <pixels>               // allowed movement per frame
+                                                        // (default 20)
+                   "roi full frame interval": <frames>  // full search at least this
+                                                        // often (default 15)
+                   "pyramid levels": <0 to 3>           // find candidates at reduced
+                                                        // resolution first (default 0)
+                   "rank by": <"size", "distance" or "center offset">  // order of
+                                                        // the "Cells" array (default
+                                                        // "size")
+                   "max targets": <count>               // most cells in "Cells"
+                                                        // (default 5)
+                   "udp host": <IP address>             // also send targets as binary
+                   "udp port": <port>                   // datagrams here (default 0,
+                                                        // off); see TargetDatagram.h
+                   "perf rate": <publishes per second>  // stage timings under
+                                                        // <table>/perf (default 2, 0 off)
+                   "overlay fps": <frames per second>   // "Processed" stream rate cap
+                                                        // while anyone watches it; none
+                                                        // is drawn otherwise (default
+                                                        // 15, 0 no cap)
+                   "latency": <true/false>              // capture-to-stage-end latency
+                                                        // under <table>/latency
+                                                        // (default false)
+                   "live tuning": <true/false>          // settings above, except lut
+                                                        // bits, camera model, angle
+                                                        // table, ground plane, udp,
+                                                        // perf rate and latency, can
+                                                        // be changed
+                                                        // under <table>/tuning
+                                                        // (default true)
                }
            }
        ]
@@ -78,12 +195,25 @@ namespace {
 
   unsigned int team;
   bool server = false;
+  double telemetryPeriod = 1.0;
+  bool matPool = true;
+  int cpuBudget = 0;  // 0: one less than the cores
 
   struct CameraConfig {
     std::string name;
     std::string path;
     wpi::json config;
     wpi::json streamConfig;
+    wpi::json visionConfig;
+    dragonvision::PipelineRunnerBase::CaptureMode captureMode =
+        dragonvision::PipelineRunnerBase::CaptureMode::kLatestFrame;
+    dragonvision::PipelineRunnerBase::FrameFormat frameFormat =
+        dragonvision::PipelineRunnerBase::FrameFormat::kBGR;
+    std::string pipeline;
+    std::string table;
+    std::string processedStream;
+    double maxFps = 0.0;
+    dragonvision::CellPipelineSettings pipelineSettings;
   };
 
   struct SwitchedCameraConfig {
@@ -99,6 +229,14 @@ namespace {
     return wpi::errs() << "config error in '" << configFile << "': ";
   }
 
+  // Reads an optional key of a camera's "vision" object; leaves value alone if absent.
+  template <typename T>
+  void ReadVisionSetting(const CameraConfig& c, const char* key, T& value) {
+    dragonvision::ReadSetting(c.visionConfig, key, value, [&]() -> wpi::raw_ostream& {
+      return ParseError() << "camera '" << c.name << "': ";
+    });
+  }
+
   bool ReadCameraConfig(const wpi::json& config) {
     CameraConfig c;
 
@@ -122,6 +260,46 @@ namespace {
     // stream properties
     if (config.count("stream") != 0) c.streamConfig = config.at("stream");
 
+    // vision settings
+    if (config.count("vision") != 0) c.visionConfig = config.at("vision");
+
+    // only the first camera runs a pipeline unless told otherwise
+    c.pipeline = cameraConfigs.empty() ? "cell" : "none";
+    ReadVisionSetting(c, "pipeline", c.pipeline);
+    if (c.pipeline != "cell" && c.pipeline != "none") {
+      ParseError() << "camera '" << c.name << "': unknown pipeline '" << c.pipeline << "'\n";
+      c.pipeline = "none";
+    }
+    // The first camera with a pipeline keeps the table and stream names from
+    // before there could be several; the others get their own
+    bool firstPipeline =
+        c.pipeline != "none" &&
+        std::none_of(cameraConfigs.begin(), cameraConfigs.end(),
+                     [](const auto& other) { return other.pipeline != "none"; });
+    c.table = firstPipeline ? "visionTable" : "visionTable/" + c.name;
+    c.processedStream = firstPipeline ? "Processed" : c.name + " Processed";
+    ReadVisionSetting(c, "table", c.table);
+    ReadVisionSetting(c, "max fps", c.maxFps);
+
+    bool asyncCapture = true;
+    ReadVisionSetting(c, "async capture", asyncCapture);
+    if (!asyncCapture)
+      c.captureMode = dragonvision::PipelineRunnerBase::CaptureMode::kSynchronous;
+
+    std::string frameFormat = "bgr";
+    ReadVisionSetting(c, "frame format", frameFormat);
+    wpi::StringRef format(frameFormat);
+    if (format.equals_lower("native")) {
+      c.frameFormat = dragonvision::PipelineRunnerBase::FrameFormat::kNative;
+    } else if (!format.equals_lower("bgr")) {
+      ParseError() << "camera '" << c.name
+                   << "': could not understand frame format value '" << frameFormat << "'\n";
+    }
+
+    dragonvision::ReadCellPipelineSettings(c.visionConfig, c.pipelineSettings, [&]() -> wpi::raw_ostream& {
+      return ParseError() << "camera '" << c.name << "': ";
+    });
+
     c.config = config;
 
     cameraConfigs.emplace_back(std::move(c));
@@ -202,6 +380,33 @@ namespace {
       }
     }
 
+    // telemetry period (optional)
+    if (j.count("telemetry period") != 0) {
+      try {
+        telemetryPeriod = j.at("telemetry period").get<double>();
+      } catch (const wpi::json::exception& e) {
+        ParseError() << "could not read telemetry period: " << e.what() << '\n';
+      }
+    }
+
+    // mat pool (optional)
+    if (j.count("mat pool") != 0) {
+      try {
+        matPool = j.at("mat pool").get<bool>();
+      } catch (const wpi::json::exception& e) {
+        ParseError() << "could not read mat pool: " << e.what() << '\n';
+      }
+    }
+
+    // cpu budget (optional)
+    if (j.count("cpu budget") != 0) {
+      try {
+        cpuBudget = j.at("cpu budget").get<int>();
+      } catch (const wpi::json::exception& e) {
+        ParseError() << "could not read cpu budget: " << e.what() << '\n';
+      }
+    }
+
     // cameras
     try {
       for (auto&& camera : j.at("cameras")) {
@@ -270,185 +475,6 @@ namespace {
 
     return server;
   }
-
-
-  // cell pipeline
-  class CellPipeline : public frc::VisionPipeline 
-  {
-    public:
-        int val = 0;
-        cs::CvSource outputStream = frc::CameraServer::GetInstance()->PutVideo("Processed", 320, 240);  
-        void Process(Mat& mat) override
-        {
-          auto ntinst = nt::NetworkTableInstance::GetDefault();
-          auto table = ntinst.GetTable("visionTable");
-            // Grab RGB camera feed
-            //Modify Constrast and Brightness to reduce noise
-            // hsvThresholdInput = Mat::zeros( mat.size(), mat.type() );
-            // for( int y = 0; y < mat.rows; y++ ){
-            //   for( int x = 0; x < mat.cols; x++ ){
-            //     for( int c = 0; c < mat.channels(); c++ ){
-            //       hsvThresholdInput.at<Vec3b>(y,x)[c]=
-            //         saturate_cast<uchar>(alpha*mat.at<Vec3b>(y,x)[c] + beta );
-            //     }
-            //   }
-
-            // }
-
-            //Gamma Correction of raw image feed
-            Mat lookUpTable(1, 256, CV_8U);
-            uchar * p = lookUpTable.ptr();
-            for( int i = 0; i <256; ++i){
-              p[i] = saturate_cast<uchar>(pow( i / 255.0, 0.9) * 255.0);
-            }
-            LUT(mat, lookUpTable, hsvThresholdInput);
-
-            contourOutput = hsvThresholdInput;
-            //Convert RGB image into HSV image
-            cvtColor(hsvThresholdInput, hsv_image, cv::COLOR_BGR2HSV);
-
-            //Blur HSV Image using median blur
-            medianBlur( hsv_image, blurOutput, 7);
-
-            //Threshold HSV image into binary image
-            //TODO:implement a way to change HSV values on the fly through network tables
-            inRange(blurOutput, Scalar(5.0, 125.0, 50.0), Scalar(50.0, 255.0, 255.0), hsvThresholdOutput);
-
-            //Use "Opening" operation to clean up binary img
-            morphologyEx(hsvThresholdOutput, openingOutput, MORPH_OPEN, 5);
-
-            //create vector to store contours
-            std::vector<std::vector<cv::Point> > contours;
-            
-
-
-            //Find the contours, and draw them on video feed, to be sent to Driver Station
-            findContours(openingOutput, contours, cv::RETR_TREE, cv::CHAIN_APPROX_SIMPLE);
-
-            std::vector<std::vector<cv::Point> > contours_poly( contours.size() );
-            std::vector<cv::Point2f>centers( contours.size() );
-            std::vector<float>radius( contours.size() );
-
-            for( size_t i = 0; i < contours.size(); i++ )
-            {
-              approxPolyDP( contours[i], contours_poly[i], 3, true);
-              minEnclosingCircle( contours_poly[i], centers[i], radius[i]);
-            }
-
-            Mat drawing = Mat::zeros(openingOutput.size(), CV_8UC3);
-
-            int         largestContourID = 0;
-            double      largestRadius = 0.0;
-            cv::Point2f largestCenter {0.0, 0.0};
-
-            for( size_t i = 0; i < contours.size(); i++ )
-            {
-                if( radius[i] < 30.0 && radius[i] > largestRadius)
-                {
-                    Scalar color {0., 255., 0.};
-                    drawContours( drawing, contours_poly, (int)i, color);
-                    circle( drawing, centers[i], (int)radius[i], color, 2);
-
-                    // String radiusText = std::to_string(radius[i]); 
-                    // putText(drawing, radiusText, centers[i], CV_FONT_HERSHEY_DUPLEX, 1.5, color, 2, LINE_4, false);
-
-                    largestRadius = radius[i];
-                    largestContourID = i;
-                    largestCenter = centers[i];
-                    table->PutNumber("largestRadius", largestRadius);
-                    table->PutNumber("largestCenter X", largestCenter.x);
-                    table->PutNumber("largestCenter Y", largestCenter.y);
-                    table->PutNumber("contourID", largestContourID);
-                }
-            }
-
-            // Draw a filled circle at the center
-            // NOTE:  May need to offset the origin to the middle of the screen so we can get positive and negative angles.
-            cv::Point2f middle { 82.5, 0.0 };
-            // Scalar color {0., 0., 255.};
-            // circle( drawing, middle, 5, color, FILLED, LINE_8);
-
-            //----------------------------------------------------------------------------------------------------------------------
-            //
-            //                |       /* largestCenter (x1, y1)
-            //                |      /
-            //                |     /
-            //                |    /
-            //                | [----horAngle
-            //                |  /
-            //                | /
-            //                |/  vertAngle
-            //                +--------------
-            //                 middle (82.5.0)
-            //
-            // Tangent is opposite over adjacent, so for the:
-            //     horizontal angle is tan((x1 - x0) / (y1 - y0))
-            //     vertical angle is tan((y1 - y0) / (x1 - x0))
-            // 
-            // Need to protect for zero divides which will occur if the largest center is on one of the axis.
-            //----------------------------------------------------------------------------------------------------------------------            
-            // Also need to watch math so that CCW angles are positive and CW angles are negative.
-            //----------------------------------------------------------------------------------------------------------------------
-            
-            double pi = 2*acos(0.0);                                                                    // not finding PI, so do math to get it
-            double deltaX = largestCenter.x-middle.x;
-            double deltaY = largestCenter.y-middle.y;
-            double horAngle  = 0.0;
-            double vertAngle = 0.0;
-            // protect for zero divide and it both values are at the middle, then the angle is 0.0;
-            if (abs(deltaY) > 0.0)
-            {
-                horAngle  = atan(deltaX / deltaY) * 180.0 / pi;               // atan is in radians so convert to degrees
-                vertAngle = 90.0 - horAngle;
-            }
-            else if (abs(deltaX) > 0.0)
-            {
-                vertAngle = atan(deltaY / deltaX) * 180.0 / pi;               // atan is in radians so convert to degrees
-                horAngle  = 90.0 - vertAngle;
-            }
-
-            // object size (real world) * focal Length (calculated) / perceived size in camera
-            double cellDistance = (7.0 * focalLength) / (2.0 * largestRadius);
-
-            table->PutNumber("NearestCellHorizontalAngle", horAngle);
-            table->PutNumber("NearestCellVerticalAngle", vertAngle);
-            table->PutNumber("NearestCellDistance", cellDistance);
-
-            /**
-            for( size_t i = 0; i < contours.size(); i++ )
-            {
-                if( radius[i] < 40 && radius[i] > 5 && radius[i] > largestRadius)
-                {
-                    largestRadius = radius[i];
-                    largestContourID = i;
-                    table->PutNumber("largestRadius", largestRadius);
-                    table->PutNumber("contourID", largestContourID);
-                }
-            }
-            **/
-
-            //double cellDistance = (7.0 * focalLength) / (2.0 * largestRadius);
-
-            // double cellAngle = 
-            //table->PutNumber("nearestCellDistance", cellDistance); //distance in inches
-            //table->PutNumber("largestRadius", largestRadius);
-            // Scalar color(0, 0, 255);
-            // drawContours(contourOutput, contours, -1, color, 2, 8);
-            outputStream.PutFrame(drawing);
-            
-        }
-        private:
-            Mat hsvThresholdInput;
-            Mat hsv_image;
-            Mat hsvThresholdOutput;
-            Mat blurOutput;
-            Mat findContoursOutput;
-            Mat openingOutput;
-            Mat contourOutput;
-            const double focalLength = 5.0;
-            double alpha = 1.0; //Contrast control value
-            int beta = -40; //Brightness control value
-    };
 }  // namespace
 
 
@@ -458,6 +484,9 @@ int main(int argc, char* argv[]) {
   // read configuration
   if (!ReadConfig()) return EXIT_FAILURE;
 
+  // before any camera or pipeline creates its buffers
+  if (matPool) dragonvision::MatPool::Install();
+
   // start NetworkTables
   auto ntinst = nt::NetworkTableInstance::GetDefault();
   if (server) {
@@ -486,15 +515,55 @@ int main(int argc, char* argv[]) {
   // start switched cameras
   for (const auto& config : switchedCameraConfigs) StartSwitchedCamera(config);
 
+  // camera delivery vs. pipeline processing rates
+  std::unique_ptr<dragonvision::CameraTelemetry> telemetry;
+  if (telemetryPeriod > 0)
+    telemetry = std::make_unique<dragonvision::CameraTelemetry>(telemetryPeriod);
+
+
+  // start image processing on every camera that has a pipeline assigned
+  int visionCameras = std::count_if(cameraConfigs.begin(), cameraConfigs.end(),
+                                    [](const auto& c) { return c.pipeline != "none"; });
+  int cores = std::max(1u, std::thread::hardware_concurrency());
+  // Leave a core for grabbing, streaming and NetworkTables by default
+  int slots = cpuBudget > 0 ? cpuBudget : std::max(1, cores - 1);
+  auto scheduler = std::make_shared<dragonvision::ProcessingScheduler>(slots);
+
+  // Several pipelines already run side by side, so split OpenCV's own worker threads
+  // between them instead of letting each one try to use every core.
+  if (visionCameras > 1) cv::setNumThreads(std::max(1, cores / visionCameras));
+
+  for (size_t i = 0; i < cameras.size(); ++i) {
+    const auto& config = cameraConfigs[i];
+    if (config.pipeline == "none") {
+      if (telemetry) {
+        telemetry->AddCamera(cameras[i], {},
+                             nt::NetworkTableInstance::GetDefault().GetTable(config.table));
+      }
+      continue;
+    }
 
-  // start image processing on camera 0 if present
-  if (cameras.size() >= 1) {
-    std::thread([&] {
-      frc::VisionRunner<CellPipeline> runner(cameras[0], new CellPipeline(),
-                                           [&](CellPipeline& pipeline) {
+    wpi::outs() << "Starting " << config.pipeline << " pipeline on '" << config.name
+                << "', publishing to " << config.table << '\n';
+    auto table = nt::NetworkTableInstance::GetDefault().GetTable(config.table);
+    auto outputStream =
+        frc::CameraServer::GetInstance()->PutVideo(config.processedStream, 320, 240);
+    std::thread([&, i, table, outputStream, scheduler] {
+      const auto& config = cameraConfigs[i];
+      dragonvision::PipelineRunner<CellPipeline> runner(cameras[i], new CellPipeline(outputStream, table,
+                                                                config.pipelineSettings),
+                                           [&](CellPipeline&) {
         // do something with pipeline results
         
-      });
+      }, config.captureMode, config.frameFormat);
+      runner.SetStatsTable(table);
+      runner.SetScheduler(scheduler);
+      runner.SetMaxFps(config.maxFps);
+      // The runner lives as long as the process, so telemetry may read its counter
+      if (telemetry) {
+        telemetry->AddCamera(cameras[i], [&runner] { return runner.GetFramesProcessed(); },
+                             table, config.maxFps);
+      }
       /* something like this for GRIP:
       frc::VisionRunner<CellPipeline> runner(cameras[0], new grip::GripPipeline(),
                                            [&](grip::GripPipeline& pipeline) {